@@ -0,0 +1,564 @@
+#ifndef __al_player_included_5029384756102938475610293847561029384756102938475610
+#define __al_player_included_5029384756102938475610293847561029384756102938475610
+
+//=======================================================================================================================================================================================================================
+// streaming OpenAL player :: a feeder thread keeps a small ring of AL buffers filled and recycles them through
+// alSourceQueueBuffers / alSourceUnqueueBuffers, so memory is constant and any length of audio can be played
+//  - the audio comes from a render callback int render(float* frames, int n) that writes at most n interleaved
+//    normalized frames and returns how many it wrote, fewer than n ends the stream
+//  - the callback runs on its own render thread, which stays up to RING_DEPTH queues of frames ahead of the device in
+//    a lock-free spsc_ring_t; the feeder only encodes and queues, so a slow render never blocks the AL calls and
+//    a late one is counted in late: the buffer it was due for waits out of the queue until the frames are there,
+//    the source plays on from the buffers still queued and only stalls if they run out
+//  - live input wants the opposite: lead limits the frames rendered ahead, the feeder wakes the render thread every
+//    time it takes a buffer, so the latency is the AL queue plus lead frames
+//  - the source starts playing as soon as the first buffer is queued
+//  - the render callback runs inside an rt::audio_scope_t, built with RT_DEBUG every allocation or lock it makes is
+//    reported; the player itself allocates all its buffers in open()
+//  - rt_options (rt_thread.hpp) ask for SCHED_FIFO, a pinned core and locked memory, set them before start(): the render
+//    thread gets the priority and the core, the feeder one priority step less, what each actually got is in its status
+//  - stats (playback_stats.hpp) records the render time and the output latency of every buffer, the device position
+//    read from AL_SAMPLE_OFFSET at every wakeup and the latency from start() to the first played frame
+//  - if the source runs dry while there is still audio to play it is restarted and the underrun is counted
+//  - adapt() lets the AL queue depth move at run time :: a starvation -- the source ran dry, or the render thread was
+//    late and the queue ran shallow -- adds a buffer at once, queued as soon as the render thread delivers it;
+//    ADAPT_SECONDS of clean playback with every render call under MAX_LOAD percent of a buffer period take one away
+//    by not refilling a played buffer; nothing is dropped or padded for it, the depth in use is in stats.queue_frames
+//  - between refills the thread sleeps until the buffer being played is expected to finish (from AL_SAMPLE_OFFSET),
+//    it is woken early only by stop(); callers block in wait() on the same condition, so an idle stream costs
+//    one wakeup per buffer period and nothing else
+//=======================================================================================================================================================================================================================
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <AL/al.h>
+#include <AL/alc.h>
+
+#include "noise.hpp"
+#include "pcm.hpp"
+#include "playback_stats.hpp"
+#include "rt_check.hpp"
+#include "rt_thread.hpp"
+#include "spsc_ring.hpp"
+
+struct al_player_t
+{
+    static const int MAX_BUFFERS = 16;
+    static const int MAX_CHANNELS = 2;
+    static const int RING_DEPTH = 2;                                /* the ring holds this many full AL queues */
+    static const int ADAPT_SECONDS = 2;                             /* a clean stretch this long makes the queue a buffer shallower */
+    static const int MAX_LOAD = 50;                                 /* ... if no render call took longer than this percentage of a period */
+
+    typedef std::function<int(float*, int)> render_f;
+
+    ALCdevice* device = 0;
+    ALCcontext* context = 0;
+    ALuint source = 0;
+    ALuint buffers[MAX_BUFFERS];
+    int frames[MAX_BUFFERS];                                        /* frames held by each buffer */
+    ALenum format = AL_FORMAT_MONO16;
+
+    int sample_rate = 44100;
+    int channels = 1;
+    int buffer_frames = 1024;                                       /* frames per AL buffer */
+    int buffer_count = 4;                                           /* AL buffers in the ring */
+    int min_depth = 4;                                              /* the bounds of the queue depth, both buffer_count unless adapt() */
+    int max_depth = 4;
+    std::atomic<int> depth { 4 };                                   /* the buffers the feeder keeps queued now */
+    std::atomic<int> grown { 0 };
+    std::atomic<int> shrunk { 0 };
+    int lead = 0;                                                   /* frames the render thread may keep ready, 0 -- as many as the ring holds */
+
+    render_f render;
+    spsc_ring_t ring;
+    std::thread render_thread;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;                                   /* signalled by stop() and when the stream is over */
+    std::condition_variable space;                                  /* signalled by the feeder when it took frames from the ring */
+    std::condition_variable delivered;                              /* signalled by the render thread when the feeder waits for frames */
+    std::atomic<bool> starving { false };                           /* the feeder waits on delivered */
+    std::atomic<bool> stop_requested { false };
+    std::atomic<bool> active { false };                             /* the render thread is running */
+    std::atomic<int> underruns { 0 };                               /* the source ran dry */
+    std::atomic<int> late { 0 };                                    /* the feeder waited over a millisecond for the render thread */
+    std::atomic<bool> rendered { false };                           /* the render callback has delivered its last frames */
+    bool ended = false;                                             /* the feeder has queued the last frames */
+    std::atomic<int64_t> render_peak { 0 };                         /* the longest render call since the feeder last looked, in us */
+
+    ALuint queue[MAX_BUFFERS];                                      /* the queued buffers oldest first, queued of them from queue_head on */
+    int queue_head = 0;
+    int queued = 0;
+    ALuint spare[MAX_BUFFERS];                                      /* the buffers out of the queue */
+    int spares = 0;
+
+    rt_options_t rt_options;
+    rt_status_t render_status;                                      /* written by the threads themselves, read them through thread_status() */
+    rt_status_t feeder_status;
+    std::atomic<int> configured { 0 };                              /* the threads that have published their status */
+    std::vector<std::pair<const void*, size_t>> regions;            /* memory of the render callback to lock with the player's own buffers */
+
+    playback_stats_t stats;
+    int64_t started = 0;                                            /* clock_us() of start() */
+    int64_t unqueued = 0;                                           /* frames in the buffers the feeder took back from the source */
+
+    noise_t noise;
+    std::vector<float> block;
+    std::vector<uint8_t> pcm16;
+
+    ~al_player_t()
+        { close(); }
+
+    //===================================================================================================================================================================================================================
+    // opens the device (0 -- the default one), creates the context, the source and the buffer ring
+    //===================================================================================================================================================================================================================
+    bool open(const char* device_name, int sample_rate, int channels = 1, int buffer_frames = 1024, int buffer_count = 4)
+    {
+        if ((channels < 1) || (channels > MAX_CHANNELS) || (buffer_count < 2) || (buffer_count > MAX_BUFFERS) || (buffer_frames < 64))
+            return false;
+
+        if (!device_name)
+            device_name = alcGetString(0, ALC_DEFAULT_DEVICE_SPECIFIER);
+        device = alcOpenDevice(device_name);
+        if (!device)
+        {
+            fprintf(stderr, "unable to open audio device %s\n", device_name ? device_name : "");
+            return false;
+        }
+
+        context = alcCreateContext(device, 0);
+        if (!context || !alcMakeContextCurrent(context))
+        {
+            fprintf(stderr, "failed to make audio context current\n");
+            close();
+            return false;
+        }
+
+        alGetError();
+        alGenSources(1, &source);
+        alSourcei(source, AL_LOOPING, AL_FALSE);
+        alGenBuffers(buffer_count, buffers);
+        if (alGetError() != AL_NO_ERROR)
+        {
+            fprintf(stderr, "failed to create the audio source and buffers\n");
+            close();
+            return false;
+        }
+
+        this->sample_rate = sample_rate;
+        this->channels = channels;
+        this->buffer_frames = buffer_frames;
+        this->buffer_count = buffer_count;
+        min_depth = max_depth = depth = buffer_count;
+        format = (channels == 2) ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16;
+        block.resize((size_t) buffer_frames * channels);
+        pcm16.resize((size_t) buffer_frames * channels * 2);
+        ring.init((size_t) RING_DEPTH * buffer_count * buffer_frames, channels);
+        return true;
+    }
+
+    //===================================================================================================================================================================================================================
+    // lets the queue depth move between min_count and max_count buffers, starting from the buffer_count of open() --
+    // the depth a stream ends with carries over to the next one; allocates, so call it after open() and before start()
+    //===================================================================================================================================================================================================================
+    bool adapt(int min_count, int max_count)
+    {
+        if (!context || (min_count < 2) || (min_count > max_count) || (max_count > MAX_BUFFERS))
+            return false;
+        stop();
+        if (max_count > buffer_count)
+        {
+            alGetError();
+            alGenBuffers(max_count - buffer_count, buffers + buffer_count);
+            if (alGetError() != AL_NO_ERROR)
+            {
+                fprintf(stderr, "failed to create the audio buffers\n");
+                return false;
+            }
+            buffer_count = max_count;
+            ring.init((size_t) RING_DEPTH * buffer_count * buffer_frames, channels);
+        }
+        min_depth = min_count;
+        max_depth = max_count;
+        depth = std::min(std::max(depth.load(), min_count), max_count);
+        return true;
+    }
+
+    /* starts the render and the feeder threads, any previous stream is stopped first */
+    bool start(render_f render)
+    {
+        if (!context)
+            return false;
+        stop();
+        this->render = render;
+        ring.reset();
+        stop_requested = false;
+        rendered = false;
+        ended = false;
+        underruns = 0;
+        late = 0;
+        grown = 0;
+        shrunk = 0;
+        render_peak = 0;
+        queue_head = 0;
+        queued = 0;
+        for (spares = 0; spares < buffer_count; ++spares)
+            spare[spares] = buffers[buffer_count - 1 - spares];
+        stats.reset(sample_rate);
+        stats.queue_frames = (int64_t) depth * buffer_frames;
+        started = clock_us();
+        unqueued = 0;
+        configured = 0;
+        active = true;
+        rt::arm();
+        if (rt_options.lock_memory)
+            render_status.locked = feeder_status.locked = lock_memory();
+        render_thread = std::thread(&al_player_t::produce, this);
+        thread = std::thread(&al_player_t::run, this);
+        return true;
+    }
+
+    int lock_memory()
+    {
+        std::vector<std::pair<const void*, size_t>> all = regions;
+        all.emplace_back(ring.data.data(), ring.data.size() * sizeof(float));
+        all.emplace_back(block.data(), block.size() * sizeof(float));
+        all.emplace_back(pcm16.data(), pcm16.size());
+        return rt::lock_memory(all);
+    }
+
+    /* copies the scheduling outcome of both threads once they have applied rt_options, false while they are starting */
+    bool thread_status(rt_status_t& render, rt_status_t& feeder) const
+    {
+        if (configured.load(std::memory_order_acquire) < 2)
+            return false;
+        render = render_status;
+        feeder = feeder_status;
+        return true;
+    }
+
+    /* true until the last rendered frame has been played or the stream was stopped */
+    bool playing() const
+        { return active; }
+
+    /* blocks until the stream is over or stopped */
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this] { return !active; });
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop_requested = true;
+        }
+        wake.notify_all();
+        space.notify_all();
+        delivered.notify_all();
+        if (render_thread.joinable())
+            render_thread.join();
+        if (thread.joinable())
+            thread.join();
+    }
+
+    void close()
+    {
+        stop();
+        if (source)
+        {
+            alDeleteSources(1, &source);
+            alDeleteBuffers(buffer_count, buffers);
+            source = 0;
+        }
+        if (context)
+        {
+            alcMakeContextCurrent(0);
+            alcDestroyContext(context);
+        }
+        if (device)
+            alcCloseDevice(device);
+        context = 0;
+        device = 0;
+    }
+
+    /* moves the next buffer from the ring to the AL buffer, returns the number of frames, 0 once the stream has ended or
+       while the render thread has not delivered a full buffer yet */
+    int fill(ALuint buffer)
+    {
+        if (ended)
+            return 0;
+
+        bool last = rendered.load(std::memory_order_acquire);                               // read before the ring, so no frames are missed
+        int n = (int) std::min<size_t>(ring.read_available(), buffer_frames);
+        if ((n < buffer_frames) && !last)
+            return 0;
+        ring.read(block.data(), n);
+        ended = (n < buffer_frames);
+        {
+            std::lock_guard<std::mutex> lock(mutex);                                        // the render thread may refill the ring now
+            space.notify_one();
+        }
+        if (n <= 0)
+            return 0;
+
+        noise.add_triangular(block.data(), n * channels, 128.0f / 32768.0f);
+        pcm::encode(block.data(), n * channels, 1, 16, false, false, pcm16.data(), 2);
+        alBufferData(buffer, format, pcm16.data(), n * channels * 2, sample_rate);
+        frames[slot(buffer)] = n;
+        stats.queued += n;
+        return n;
+    }
+
+    void enqueue(ALuint buffer)
+    {
+        alSourceQueueBuffers(source, 1, &buffer);
+        queue[(queue_head + queued++) % MAX_BUFFERS] = buffer;
+    }
+
+    /* takes back the oldest buffer, which the source has played */
+    ALuint dequeue()
+    {
+        ALuint buffer;
+        alSourceUnqueueBuffers(source, 1, &buffer);
+        queue_head = (queue_head + 1) % MAX_BUFFERS;
+        --queued;
+        unqueued += frames[slot(buffer)];
+        return buffer;
+    }
+
+    bool frames_ready()
+        { return stop_requested || rendered || (ring.read_available() >= (size_t) buffer_frames); }
+
+    /* blocks until the render thread has a full buffer ready, the stream is over or stop(), returns the time waited in us */
+    int64_t await_frames()
+    {
+        if (frames_ready())
+            return 0;
+        int64_t t0 = clock_us();
+        auto period = std::chrono::microseconds(std::max<int64_t>(1000, (int64_t) buffer_frames * 1000000 / sample_rate));
+        std::unique_lock<std::mutex> lock(mutex);
+        starving = true;
+        while (!frames_ready())
+            delivered.wait_for(lock, period);                                               // the timeout only guards against a lost wakeup
+        starving = false;
+        return clock_us() - t0;
+    }
+
+    /* wakes the feeder if it waits for the frames just committed, called by the render thread */
+    void deliver()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);                                // orders the commit before the look at starving
+        if (starving.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            delivered.notify_one();
+        }
+    }
+
+    /* queues spare buffers until the queue is depth deep, waiting for the render thread to deliver each of them */
+    void top_up()
+    {
+        while (!stop_requested && (queued < depth) && (spares > 0))
+        {
+            if (await_frames() > 1000)
+                ++late;
+            if (fill(spare[spares - 1]) <= 0)
+                return;
+            enqueue(spare[--spares]);
+        }
+    }
+
+    int slot(ALuint buffer) const
+    {
+        int i = 0;
+        while ((i < buffer_count - 1) && (buffers[i] != buffer))
+            ++i;
+        return i;
+    }
+
+    /* sleeps for the given number of frames, but at least a millisecond, or until stop() */
+    void pause(int frames)
+    {
+        auto period = std::chrono::microseconds(std::max<int64_t>(1000, (int64_t) frames * 1000000 / sample_rate));
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait_for(lock, period, [this] { return stop_requested.load(); });
+    }
+
+    /* publishes the device position and sleeps until the buffer at the head of the queue should be finished */
+    void idle()
+    {
+        ALint offset = 0;
+        alGetSourcei(source, AL_SAMPLE_OFFSET, &offset);
+        stats.device_position(unqueued + offset, clock_us());
+        pause(buffer_frames - (offset % buffer_frames));
+    }
+
+    /* true while the render thread may add another buffer to the ring */
+    bool room()
+    {
+        size_t limit = lead ? std::min<size_t>(lead, ring.capacity) : ring.capacity;
+        return ring.size() + buffer_frames <= limit;
+    }
+
+    //===================================================================================================================================================================================================================
+    // the render thread :: calls the render callback straight into the free space of the ring, a buffer at a time,
+    // and sleeps whenever the ring holds lead frames -- until the feeder takes some or for a buffer period at most
+    //===================================================================================================================================================================================================================
+    void produce()
+    {
+        int locked = render_status.locked;
+        render_status = rt::configure_thread(rt_options, "render");
+        render_status.locked = locked;
+        configured.fetch_add(1, std::memory_order_release);
+        rt::prefault_stack();
+
+        auto period = std::chrono::microseconds(std::max<int64_t>(1000, (int64_t) buffer_frames * 1000000 / sample_rate));
+        while (!stop_requested)
+        {
+            spsc_ring_t::span_t span;
+            if (!room() || (ring.write_span(span, buffer_frames) < (size_t) buffer_frames))
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                space.wait_for(lock, period, [this] { return stop_requested || room(); });
+                continue;
+            }
+
+            int n;
+            int64_t t0 = clock_us();
+            {
+                rt::audio_scope_t audio;
+                n = render(span.first, (int) span.first_frames);
+                if ((n == (int) span.first_frames) && (span.second_frames > 0))
+                    n += render(span.second, (int) span.second_frames);
+            }
+            int64_t t1 = clock_us();
+            stats.render_time.add(t1 - t0);
+            if (t1 - t0 > render_peak.load(std::memory_order_relaxed))
+                render_peak.store(t1 - t0, std::memory_order_relaxed);
+            int64_t play = stats.play_time(stats.rendered);
+            if (play)
+                stats.output_latency.add(play - t1);
+            stats.rendered += n;
+            ring.commit_write(n);
+            deliver();
+            if (n < buffer_frames)
+                break;
+        }
+        rendered.store(true, std::memory_order_release);
+        deliver();
+    }
+
+    //===================================================================================================================================================================================================================
+    // the feeder thread :: primes the AL queue as the render thread delivers -- the first buffer starts the source
+    // right away -- then refills every buffer the source has finished with until the stream ends and the queue drains,
+    // and moves the depth of the queue between its bounds after every wakeup
+    //===================================================================================================================================================================================================================
+    void run()
+    {
+        rt_options_t options = rt_options;
+        options.priority = std::max(0, options.priority - 1);
+        options.cpu = -1;
+        int locked = feeder_status.locked;
+        feeder_status = rt::configure_thread(options, "feeder");
+        feeder_status.locked = locked;
+        configured.fetch_add(1, std::memory_order_release);
+
+        while (!stop_requested && (queued < depth) && (spares > 0))
+        {
+            await_frames();
+            if (fill(spare[spares - 1]) <= 0)
+                break;
+            enqueue(spare[--spares]);
+            if (queued == 1)
+            {
+                alSourcePlay(source);
+                stats.device_position(0, clock_us());
+                stats.event(started, 0);
+            }
+        }
+
+        int64_t window = std::max(1, ADAPT_SECONDS * sample_rate / buffer_frames);                  // in buffer periods
+        int64_t budget = (int64_t) buffer_frames * 10000 * MAX_LOAD / sample_rate;                  // in us
+        int starved = 0;
+        int64_t clean = 0;
+        while (!stop_requested && (queued > 0))
+        {
+            ALint processed = 0;
+            alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+            for (; processed > 0; --processed)
+            {
+                ALuint buffer = dequeue();
+                if ((queued < depth) && (fill(buffer) > 0))
+                    enqueue(buffer);
+                else
+                    spare[spares++] = buffer;                                               // the stream has ended, the render thread is late or the queue shrinks
+                ++clean;
+            }
+
+            ALint state = AL_STOPPED;
+            alGetSourcei(source, AL_SOURCE_STATE, &state);
+            if ((state != AL_PLAYING) && (queued > 0))
+            {
+                ALint pending = 0;
+                alGetSourcei(source, AL_BUFFERS_PROCESSED, &pending);
+                if (pending > 0)
+                    continue;
+            }
+            bool stalled = (state != AL_PLAYING) && ((queued > 0) || !ended);                      // not the end of the stream
+            if (stalled)
+                ++underruns;
+
+            if (underruns + late != starved)
+            {
+                starved = underruns + late;
+                clean = 0;
+                render_peak = 0;
+                if (depth < max_depth)
+                {
+                    ++depth;
+                    ++grown;
+                }
+            }
+            else if (clean >= window)
+            {
+                if ((depth > min_depth) && (render_peak.exchange(0) < budget))
+                {
+                    --depth;
+                    ++shrunk;
+                }
+                clean = 0;
+                render_peak = 0;
+            }
+            stats.queue_frames.store((int64_t) depth * buffer_frames, std::memory_order_relaxed);
+            top_up();
+
+            if (stalled && (queued > 0))
+            {
+                alSourcePlay(source);
+                continue;
+            }
+            idle();
+        }
+
+        alSourceStop(source);
+        alSourcei(source, AL_BUFFER, 0);                                                     // detaches all the queued buffers
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            active = false;
+        }
+        wake.notify_all();
+    }
+};
+
+#endif /* __al_player_included_5029384756102938475610293847561029384756102938475610 */
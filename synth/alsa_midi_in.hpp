@@ -0,0 +1,180 @@
+#ifndef __alsa_midi_in_included_9950192847561029384756102938475610293847561029384756
+#define __alsa_midi_in_included_9950192847561029384756102938475610293847561029384756
+
+//=======================================================================================================================================================================================================================
+// ALSA sequencer MIDI input :: a client "msynth" with a writable port "input", read by its own thread
+//  - note on / note off / controller events become note_event_t and go to the audio thread through the lock-free
+//    event_queue_t, the same queue the computer keyboard posts to
+//  - the port stamps every event with the real time of a sequencer queue when it arrives in the kernel, so the time an
+//    event was played does not depend on when this thread gets to read it; the queue time is mapped onto clock_us()
+//    by the smallest delay seen between a stamp and its read -- that delay is the scheduling jitter of this thread --
+//    and the mapping may follow a clock drift of up to 100 ppm; live_synth_t then schedules every event a fixed delay
+//    after its stamp, which cancels the jitter of the input and of the render thread alike
+//  - no hardware is needed to try it: connect any sequencer client to the port, e.g.
+//        aconnect -l                           -- find the port, say 128:0
+//        aplaymidi -p 128:0 song.mid           -- plays a file into it
+//    or pass a source address to open() to subscribe to it directly, the kernel's Midi Through port 14:0 included
+// the file compiles to nothing without HAVE_ALSA, CMake defines it when it finds the ALSA library
+//=======================================================================================================================================================================================================================
+
+#ifdef HAVE_ALSA
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <alsa/asoundlib.h>
+#include <poll.h>
+
+#include "event_queue.hpp"
+#include "playback_stats.hpp"
+
+struct alsa_midi_in_t
+{
+    snd_seq_t* seq = 0;
+    int port = -1;
+    int queue = -1;
+    event_queue_t* events = 0;
+
+    std::thread thread;
+    std::atomic<bool> stop_requested { false };
+    std::atomic<uint64_t> received { 0 };                           /* events posted to the queue */
+    std::atomic<uint64_t> lost { 0 };                               /* events the sequencer dropped because we read too late */
+
+    int64_t base = 0;                                               /* clock_us() of queue time 0, the estimate */
+    int64_t last = 0;                                               /* clock_us() of the last event */
+
+    ~alsa_midi_in_t()
+        { close(); }
+
+    //===================================================================================================================================================================================================================
+    // creates the client, the timestamping queue and the port, subscribes to source ("client:port", 0 -- none) and
+    // starts the input thread
+    //===================================================================================================================================================================================================================
+    bool open(event_queue_t& events, const char* source = 0)
+    {
+        this->events = &events;
+        if (snd_seq_open(&seq, "default", SND_SEQ_OPEN_INPUT, 0) < 0)
+        {
+            fprintf(stderr, "unable to open the ALSA sequencer\n");
+            seq = 0;
+            return false;
+        }
+        snd_seq_set_client_name(seq, "msynth");
+
+        queue = snd_seq_alloc_named_queue(seq, "msynth");
+        snd_seq_port_info_t* info;
+        snd_seq_port_info_alloca(&info);
+        snd_seq_port_info_set_name(info, "input");
+        snd_seq_port_info_set_capability(info, SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE);
+        snd_seq_port_info_set_type(info, SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+        snd_seq_port_info_set_timestamping(info, 1);
+        snd_seq_port_info_set_timestamp_real(info, 1);
+        snd_seq_port_info_set_timestamp_queue(info, queue);
+        if ((queue < 0) || (snd_seq_create_port(seq, info) < 0))
+        {
+            fprintf(stderr, "unable to create the ALSA sequencer port\n");
+            close();
+            return false;
+        }
+        port = snd_seq_port_info_get_port(info);
+
+        if (source)
+        {
+            snd_seq_addr_t address;
+            if ((snd_seq_parse_address(seq, &address, source) < 0) || (snd_seq_connect_from(seq, port, address.client, address.port) < 0))
+                fprintf(stderr, "unable to connect from the MIDI port %s\n", source);
+        }
+
+        snd_seq_start_queue(seq, queue, 0);
+        snd_seq_drain_output(seq);
+        base = last = clock_us();
+        fprintf(stdout, "MIDI input on ALSA sequencer port %d:%d\n", snd_seq_client_id(seq), port);
+
+        stop_requested = false;
+        thread = std::thread(&alsa_midi_in_t::run, this);
+        return true;
+    }
+
+    void close()
+    {
+        stop_requested = true;
+        if (thread.joinable())
+            thread.join();
+        if (seq)
+        {
+            if (queue >= 0)
+                snd_seq_free_queue(seq, queue);
+            snd_seq_close(seq);
+        }
+        seq = 0;
+        port = -1;
+        queue = -1;
+    }
+
+    /* the clock_us() time an event was stamped at, now if it carries no real-time stamp */
+    int64_t stamp(const snd_seq_event_t* ev, int64_t now)
+    {
+        if ((ev->flags & SND_SEQ_TIME_STAMP_MASK) != SND_SEQ_TIME_STAMP_REAL)
+            return now;
+
+        int64_t time = (int64_t) ev->time.time.tv_sec * 1000000 + ev->time.time.tv_nsec / 1000;
+        int64_t candidate = now - time;                                                     // base plus the delay of this read
+        if (candidate < base)
+            base = candidate;
+        else
+            base += std::min(candidate - base, (now - last) / 10000);                       // follow a drift of up to 100 ppm
+        last = now;
+        return std::min(base + time, now);
+    }
+
+    //===================================================================================================================================================================================================================
+    // the input thread :: waits for the sequencer with poll(), so it can look at stop_requested every 100 ms
+    //===================================================================================================================================================================================================================
+    void run()
+    {
+        snd_seq_nonblock(seq, 1);
+        std::vector<pollfd> fds(snd_seq_poll_descriptors_count(seq, POLLIN));
+        snd_seq_poll_descriptors(seq, fds.data(), (unsigned int) fds.size(), POLLIN);
+
+        while (!stop_requested)
+        {
+            if (poll(fds.data(), fds.size(), 100) <= 0)
+                continue;
+
+            snd_seq_event_t* ev;
+            int result;
+            while ((result = snd_seq_event_input(seq, &ev)) >= 0)
+            {
+                int64_t time = stamp(ev, clock_us());
+                note_event_t event;
+                switch (ev->type)
+                {
+                    case SND_SEQ_EVENT_NOTEON:
+                        event = note_event_t::make(note_event_t::NOTE_ON, ev->data.note.note, ev->data.note.velocity, time, ev->data.note.channel);
+                        break;
+                    case SND_SEQ_EVENT_NOTEOFF:
+                        event = note_event_t::make(note_event_t::NOTE_OFF, ev->data.note.note, 0, time, ev->data.note.channel);
+                        break;
+                    case SND_SEQ_EVENT_CONTROLLER:
+                        event = note_event_t::make(note_event_t::CONTROL, ev->data.control.param & 0x7F, ev->data.control.value & 0x7F, time, ev->data.control.channel);
+                        break;
+                    default:
+                        continue;
+                }
+                if (events->push(event))
+                    ++received;
+            }
+            if (result == -ENOSPC)
+                ++lost;
+        }
+    }
+};
+
+#endif
+
+#endif /* __alsa_midi_in_included_9950192847561029384756102938475610293847561029384756 */
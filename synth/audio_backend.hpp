@@ -0,0 +1,259 @@
+#ifndef __audio_backend_included_6630192847561029384756102938475610293847561029384
+#define __audio_backend_included_6630192847561029384756102938475610293847561029384
+
+//=======================================================================================================================================================================================================================
+// audio output backends :: everything the engine plays through pulls frames from the same render callback
+// int render(float* frames, int n), which writes at most n interleaved normalized frames and returns how many it
+// wrote, fewer than n ends the stream
+//  - openal_backend_t : the streaming al_player_t, paced by the audio device
+//  - null_backend_t   : discards the frames, pulls them as fast as the engine renders them
+//  - file_backend_t   : the same, but the frames go to a stream_writer_t -- a WAV or RAW file, a FIFO or stdout
+// the offline backends run on their own thread just like the player, so the caller code is the same for all of them,
+// and need no device -- benchmarks and batch renders work on headless servers
+// real_time_factor() is the seconds of audio rendered per second of render time :: for the offline backends the whole
+// loop including the sink, for OpenAL the render callback alone, as the device paces the stream
+//=======================================================================================================================================================================================================================
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "al_player.hpp"
+#include "stream_writer.hpp"
+
+struct audio_backend_t
+{
+    typedef std::function<int(float*, int)> render_f;
+
+    int sample_rate = 44100;
+    int channels = 1;
+
+    virtual ~audio_backend_t()
+        { }
+
+    virtual const char* name() const = 0;
+    virtual bool start(render_f render) = 0;
+    virtual bool playing() const = 0;
+    virtual void wait() = 0;
+    virtual void stop() = 0;
+    virtual int64_t frames() const = 0;                             /* frames rendered since start() */
+    virtual double real_time_factor() const = 0;
+};
+
+//=======================================================================================================================================================================================================================
+// OpenAL device
+//=======================================================================================================================================================================================================================
+struct openal_backend_t : public audio_backend_t
+{
+    al_player_t player;
+
+    /* device_name 0 -- the default device */
+    bool open(const char* device_name, int sample_rate, int channels = 1, int buffer_frames = 1024, int buffer_count = 4)
+    {
+        this->sample_rate = sample_rate;
+        this->channels = channels;
+        return player.open(device_name, sample_rate, channels, buffer_frames, buffer_count);
+    }
+
+    const char* name() const override
+        { return "openal"; }
+
+    bool start(render_f render) override
+        { return player.start(render); }
+
+    bool playing() const override
+        { return player.playing(); }
+
+    void wait() override
+        { player.wait(); }
+
+    void stop() override
+        { player.stop(); }
+
+    int64_t frames() const override
+        { return player.stats.rendered.load(); }
+
+    double real_time_factor() const override
+    {
+        int64_t us = player.stats.render_time.mean();
+        return us ? (1000000.0 * player.buffer_frames / sample_rate) / us : 0.0;
+    }
+};
+
+//=======================================================================================================================================================================================================================
+// offline backends :: a thread pulls BLOCK_SIZE frames at a time and hands them to consume() until the stream ends
+//=======================================================================================================================================================================================================================
+struct offline_backend_t : public audio_backend_t
+{
+    static const int BLOCK_SIZE = 4096;
+
+    render_f render;
+    std::vector<float> block;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable done;
+    std::atomic<bool> stop_requested { false };
+    std::atomic<bool> active { false };
+    std::atomic<int64_t> rendered { 0 };
+    std::atomic<int64_t> elapsed_us { 0 };
+
+    ~offline_backend_t() override
+        { stop(); }
+
+    virtual bool consume(float* frames, int n) = 0;                 /* false -- the sink failed, the stream ends */
+    virtual void finish()
+        { }
+
+    bool start(render_f render) override
+    {
+        stop();
+        this->render = render;
+        block.resize((size_t) BLOCK_SIZE * channels);
+        stop_requested = false;
+        rendered = 0;
+        elapsed_us = 0;
+        active = true;
+        thread = std::thread(&offline_backend_t::run, this);
+        return true;
+    }
+
+    bool playing() const override
+        { return active; }
+
+    void wait() override
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return !active; });
+    }
+
+    void stop() override
+    {
+        stop_requested = true;
+        if (thread.joinable())
+            thread.join();
+    }
+
+    int64_t frames() const override
+        { return rendered.load(); }
+
+    double real_time_factor() const override
+    {
+        int64_t us = elapsed_us.load();
+        return us ? (1000000.0 * rendered.load() / sample_rate) / us : 0.0;
+    }
+
+    void run()
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        int n = BLOCK_SIZE;
+        while (!stop_requested && (n == BLOCK_SIZE))
+        {
+            n = render(block.data(), BLOCK_SIZE);
+            if ((n > 0) && !consume(block.data(), n))
+                break;
+            rendered += std::max(n, 0);
+            elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+        }
+        finish();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            active = false;
+        }
+        done.notify_all();
+    }
+};
+
+struct null_backend_t : public offline_backend_t
+{
+    ~null_backend_t() override
+        { stop(); }
+
+    void open(int sample_rate, int channels = 1)
+    {
+        this->sample_rate = sample_rate;
+        this->channels = channels;
+    }
+
+    const char* name() const override
+        { return "null"; }
+
+    bool consume(float*, int) override
+        { return true; }
+};
+
+struct file_backend_t : public offline_backend_t
+{
+    stream_writer_t writer;
+    std::string path;
+
+    ~file_backend_t() override
+        { stop(); }                                                 // the thread may still be writing
+
+    /* a path ending in .raw gets headerless PCM, anything else -- "-" for stdout included -- a streaming WAV header */
+    bool open(const std::string& path, int sample_rate, int channels = 1, int bit_depth = 16)
+    {
+        this->path = path;
+        this->sample_rate = sample_rate;
+        this->channels = channels;
+        bool raw = (path.size() > 4) && (path.compare(path.size() - 4, 4, ".raw") == 0);
+        if (writer.open(path, raw ? stream_writer_t::RAW : stream_writer_t::WAV, sample_rate, channels, bit_depth))
+            return true;
+        fprintf(stderr, "unable to open %s for writing\n", path.c_str());
+        return false;
+    }
+
+    const char* name() const override
+        { return "file"; }
+
+    /* a closed pipe or a full disk stops the rendering instead of discarding the rest of the stream */
+    bool consume(float* frames, int n) override
+    {
+        writer.write(frames, n);
+        return writer.ok;
+    }
+
+    void finish() override
+    {
+        if (!writer.close())
+            fprintf(stderr, "failed to write %s\n", path.c_str());
+    }
+};
+
+//=======================================================================================================================================================================================================================
+// opens the backend by name :: "openal" or "openal:DEVICE", "null", anything else is a file path
+// a missing OpenAL device falls back to the null backend so that the caller still runs
+// the buffer size and count only apply to OpenAL, the offline backends always pull BLOCK_SIZE frames
+//=======================================================================================================================================================================================================================
+inline std::unique_ptr<audio_backend_t> open_backend(const std::string& name, int sample_rate, int channels = 1, int buffer_frames = 1024, int buffer_count = 4)
+{
+    if ((name == "openal") || (name.compare(0, 7, "openal:") == 0))
+    {
+        std::unique_ptr<openal_backend_t> backend(new openal_backend_t());
+        if (backend->open((name.size() > 7) ? name.c_str() + 7 : 0, sample_rate, channels, buffer_frames, buffer_count))
+            return backend;
+        fprintf(stderr, "no audio device, falling back to the null backend\n");
+    }
+    else if (name != "null")
+    {
+        std::unique_ptr<file_backend_t> backend(new file_backend_t());
+        if (!backend->open(name, sample_rate, channels))
+            return 0;
+        return backend;
+    }
+
+    std::unique_ptr<null_backend_t> backend(new null_backend_t());
+    backend->open(sample_rate, channels);
+    return backend;
+}
+
+#endif /* __audio_backend_included_6630192847561029384756102938475610293847561029384 */
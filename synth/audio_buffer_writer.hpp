@@ -0,0 +1,66 @@
+#ifndef __audio_buffer_writer_included_7120938475610293847561029384756102938475610
+#define __audio_buffer_writer_included_7120938475610293847561029384756102938475610
+
+//=======================================================================================================================================================================================================================
+// mixer sink that renders into the sample buffer of an AudioFile<float>, which is then saved with AudioFile::save as
+// WAV or AIFF -- one header writer and one encoder (pcm::encode) for every file format
+// the buffer is sized once per score from the computed length, the channel vectors keep their capacity,
+// so a writer and an AudioFile reused for a whole batch allocate only while the longest score so far grows
+//=======================================================================================================================================================================================================================
+
+#include <cstdint>
+#include <string>
+
+#include "audio_file.hpp"
+#include "mixer.hpp"
+#include "noise.hpp"
+
+struct audio_buffer_writer_t
+{
+    AudioFile<float>* file = 0;
+    int channels = 1;
+    int64_t position = 0;                                           /* frames written since begin() */
+    noise_t noise;
+
+    /* prepares the file for length frames, 32-bit WAV files are saved as IEEE float */
+    void begin(AudioFile<float>& file, int sample_rate, int channels, int bit_depth, int64_t length)
+    {
+        this->file = &file;
+        this->channels = channels;
+        position = 0;
+        file.setSampleRate(sample_rate);
+        file.setBitDepth(bit_depth);
+        file.setAudioBufferSize(channels, (int) length);
+    }
+
+    /* dithers n interleaved frames of normalized samples and spreads them over the channel buffers, the block is modified in place */
+    void write(float* block, int n)
+    {
+        noise.add_triangular(block, n * channels, 128.0f / 32768.0f);                                             /* A bit of noise makes it sound better */
+
+        for (int c = 0; c < channels; ++c)
+        {
+            float* dst = file->samples[c].data() + position;
+            for (int k = 0; k < n; ++k)
+                dst[k] = block[k * channels + c];
+        }
+        position += n;
+    }
+
+    int64_t bytes() const
+        { return position * channels * (file->getBitDepth() / 8); }
+
+    static void notes2file(const std::string& filename, const note_t* notes, int size, int sample_rate, const instrument_t& instrument = instruments[0],
+                           AudioFileFormat format = AudioFileFormat::Wave)
+    {
+        AudioFile<float> file;
+        audio_buffer_writer_t writer;
+        mixer_t mixer(sample_rate);
+        score_t score = sequential_score(notes, size);
+        writer.begin(file, sample_rate, 1, 16, mixer.length(score, instrument));
+        mixer.render(score, instrument, writer);
+        file.save(filename, format);
+    }
+};
+
+#endif /* __audio_buffer_writer_included_7120938475610293847561029384756102938475610 */
@@ -11,9 +11,11 @@
 #include <string>
 #include <cstring>
 #include <fstream>
-#include <unordered_map>
 #include <iterator>
 #include <algorithm>
+#include <limits>
+
+#include "pcm.hpp"
 
 enum class AudioFileFormat
 {
@@ -109,7 +111,6 @@ template <class T> struct AudioFile
     T singleByteToSample (uint8_t sample);
 
     uint32_t getAiffSampleRate (std::vector<uint8_t>& fileData, int sampleRateStartIndex);
-    bool tenByteMatch (std::vector<uint8_t>& v1, int startIndex1, std::vector<uint8_t>& v2, int startIndex2);
     void addSampleRateToAiffData (std::vector<uint8_t>& fileData, uint32_t sampleRate);
     T clamp (T v1, T minValue, T maxValue);
 
@@ -117,39 +118,18 @@ template <class T> struct AudioFile
     void addInt32ToFileData (std::vector<uint8_t>& fileData, int32_t i, Endianness endianness = Endianness::LittleEndian);
     void addInt16ToFileData (std::vector<uint8_t>& fileData, int16_t i, Endianness endianness = Endianness::LittleEndian);
 
+    bool encodeSamples (std::vector<uint8_t>& fileData, bool floatingPoint, Endianness endianness);
     bool writeDataToFile (std::vector<uint8_t>& fileData, std::string filePath);
     void reportError (std::string errorMessage);
 
     AudioFileFormat audioFileFormat;
+    std::vector<uint8_t> saveData;              /* encoded file image, kept between saves so repeated saves do not reallocate */
     uint32_t sampleRate;
     int bitDepth;
     bool logErrorsToConsole {true};
 };
 
 
-/* Pre-defined 10-byte representations of common sample rates */
-static std::unordered_map <uint32_t, std::vector<uint8_t>> aiffSampleRateTable =
-{
-    {   8000, {64, 11, 250,   0, 0, 0, 0, 0, 0, 0}},
-    {  11025, {64, 12, 172,  68, 0, 0, 0, 0, 0, 0}},
-    {  16000, {64, 12, 250,   0, 0, 0, 0, 0, 0, 0}},
-    {  22050, {64, 13, 172,  68, 0, 0, 0, 0, 0, 0}},
-    {  32000, {64, 13, 250,   0, 0, 0, 0, 0, 0, 0}},
-    {  37800, {64, 14, 147, 168, 0, 0, 0, 0, 0, 0}},
-    {  44056, {64, 14, 172,  24, 0, 0, 0, 0, 0, 0}},
-    {  44100, {64, 14, 172,  68, 0, 0, 0, 0, 0, 0}},
-    {  47250, {64, 14, 184, 146, 0, 0, 0, 0, 0, 0}},
-    {  48000, {64, 14, 187, 128, 0, 0, 0, 0, 0, 0}},
-    {  50000, {64, 14, 195,  80, 0, 0, 0, 0, 0, 0}},
-    {  50400, {64, 14, 196, 224, 0, 0, 0, 0, 0, 0}},
-    {  88200, {64, 15, 172,  68, 0, 0, 0, 0, 0, 0}},
-    {  96000, {64, 15, 187, 128, 0, 0, 0, 0, 0, 0}},
-    { 176400, {64, 16, 172,  68, 0, 0, 0, 0, 0, 0}},
-    { 192000, {64, 16, 187, 128, 0, 0, 0, 0, 0, 0}},
-    { 352800, {64, 17, 172,  68, 0, 0, 0, 0, 0, 0}},
-    {2822400, {64, 20, 172,  68, 0, 0, 0, 0, 0, 0}},
-    {5644800, {64, 21, 172,  68, 0, 0, 0, 0, 0, 0}}
-};
 
 enum WavAudioFormat
 {
@@ -611,33 +591,33 @@ template <class T> bool AudioFile<T>::decodeAiffFile (std::vector<uint8_t>& file
 
 template <class T> uint32_t AudioFile<T>::getAiffSampleRate (std::vector<uint8_t>& fileData, int sampleRateStartIndex)
 {
-    for (auto it : aiffSampleRateTable)
-    {
-        if (tenByteMatch (fileData, sampleRateStartIndex, it.second, 0))
-            return it.first;
-    }
+    /* 80-bit IEEE extended : sign and 15-bit exponent biased by 16383, then a 64-bit mantissa with an explicit integer bit */
+    const uint8_t* b = &fileData[sampleRateStartIndex];
+    int exponent = (((b[0] & 0x7F) << 8) | b[1]) - 16383;
+    uint64_t mantissa = 0;
+    for (int i = 0; i < 8; i++)
+        mantissa = (mantissa << 8) | b[2 + i];
 
-    return 0;
-}
-
-template <class T> bool AudioFile<T>::tenByteMatch (std::vector<uint8_t>& v1, int startIndex1, std::vector<uint8_t>& v2, int startIndex2)
-{
-    for (int i = 0; i < 10; i++)
-    {
-        if (v1[startIndex1 + i] != v2[startIndex2 + i])
-            return false;
-    }
+    if ((b[0] & 0x80) || exponent < 0 || exponent > 31)
+        return 0;
 
-    return true;
+    return (uint32_t) (mantissa >> (63 - exponent));
 }
 
 template <class T> void AudioFile<T>::addSampleRateToAiffData (std::vector<uint8_t>& fileData, uint32_t sampleRate)
 {
-    if (aiffSampleRateTable.count (sampleRate) > 0)
-    {
-        for (int i = 0; i < 10; i++)
-            fileData.push_back (aiffSampleRateTable[sampleRate][i]);
-    }
+    /* any integer rate is exact in the 80-bit extended format, see getAiffSampleRate */
+    int exponent = 0;
+    while (exponent < 31 && (sampleRate >> (exponent + 1)) != 0)
+        exponent++;
+
+    uint64_t mantissa = (sampleRate == 0) ? 0 : (uint64_t) sampleRate << (63 - exponent);
+    int biased = (sampleRate == 0) ? 0 : exponent + 16383;
+
+    fileData.push_back ((uint8_t) (biased >> 8));
+    fileData.push_back ((uint8_t) biased);
+    for (int i = 7; i >= 0; i--)
+        fileData.push_back ((uint8_t) (mantissa >> (8 * i)));
 }
 
 template <class T> bool AudioFile<T>::save (std::string filePath, AudioFileFormat format)
@@ -652,7 +632,8 @@ template <class T> bool AudioFile<T>::save (std::string filePath, AudioFileForma
 
 template <class T> bool AudioFile<T>::saveToWaveFile (std::string filePath)
 {
-    std::vector<uint8_t> fileData;
+    std::vector<uint8_t>& fileData = saveData;
+    fileData.clear();
 
     int32_t dataChunkSize = getNumSamplesPerChannel() * (getNumChannels() * bitDepth / 8);
     int16_t audioFormat = bitDepth == 32 ? WavAudioFormat::IEEEFloat : WavAudioFormat::PCM;
@@ -696,50 +677,10 @@ template <class T> bool AudioFile<T>::saveToWaveFile (std::string filePath)
     addStringToFileData (fileData, "data");
     addInt32ToFileData (fileData, dataChunkSize);
 
-    for (int i = 0; i < getNumSamplesPerChannel(); i++)
+    if (!encodeSamples (fileData, audioFormat == WavAudioFormat::IEEEFloat, Endianness::LittleEndian))
     {
-        for (int channel = 0; channel < getNumChannels(); channel++)
-        {
-            if (bitDepth == 8)
-            {
-                uint8_t byte = sampleToSingleByte (samples[channel][i]);
-                fileData.push_back (byte);
-            }
-            else if (bitDepth == 16)
-            {
-                int16_t sampleAsInt = sampleToSixteenBitInt (samples[channel][i]);
-                addInt16ToFileData (fileData, sampleAsInt);
-            }
-            else if (bitDepth == 24)
-            {
-                int32_t sampleAsIntAgain = (int32_t) (samples[channel][i] * (T)8388608.);
-
-                uint8_t bytes[3];
-                bytes[2] = (uint8_t) (sampleAsIntAgain >> 16) & 0xFF;
-                bytes[1] = (uint8_t) (sampleAsIntAgain >>  8) & 0xFF;
-                bytes[0] = (uint8_t) sampleAsIntAgain & 0xFF;
-
-                fileData.push_back (bytes[0]);
-                fileData.push_back (bytes[1]);
-                fileData.push_back (bytes[2]);
-            }
-            else if (bitDepth == 32)
-            {
-                int32_t sampleAsInt;
-
-                if (audioFormat == WavAudioFormat::IEEEFloat)
-                    sampleAsInt = (int32_t) reinterpret_cast<int32_t&> (samples[channel][i]);
-                else // assume PCM
-                    sampleAsInt = (int32_t) (samples[channel][i] * std::numeric_limits<int32_t>::max());
-
-                addInt32ToFileData (fileData, sampleAsInt, Endianness::LittleEndian);
-            }
-            else
-            {
-                assert (false && "Trying to write a file with unsupported bit depth");
-                return false;
-            }
-        }
+        assert (false && "Trying to write a file with unsupported bit depth");
+        return false;
     }
 
     /* iXML CHUNK */
@@ -763,7 +704,8 @@ template <class T> bool AudioFile<T>::saveToWaveFile (std::string filePath)
 
 template <class T> bool AudioFile<T>::saveToAiffFile (std::string filePath)
 {
-    std::vector<uint8_t> fileData;
+    std::vector<uint8_t>& fileData = saveData;
+    fileData.clear();
 
     int32_t numBytesPerSample = bitDepth / 8;
     int32_t numBytesPerFrame = numBytesPerSample * getNumChannels();
@@ -800,45 +742,11 @@ template <class T> bool AudioFile<T>::saveToAiffFile (std::string filePath)
     addInt32ToFileData (fileData, 0, Endianness::BigEndian); // offset
     addInt32ToFileData (fileData, 0, Endianness::BigEndian); // block size
 
-    for (int i = 0; i < getNumSamplesPerChannel(); i++)
+    /* 32-bit samples are written as signed integers, there is no floating point AIFF-C support yet */
+    if (!encodeSamples (fileData, false, Endianness::BigEndian))
     {
-        for (int channel = 0; channel < getNumChannels(); channel++)
-        {
-            if (bitDepth == 8)
-            {
-                uint8_t byte = sampleToSingleByte (samples[channel][i]);
-                fileData.push_back (byte);
-            }
-            else if (bitDepth == 16)
-            {
-                int16_t sampleAsInt = sampleToSixteenBitInt (samples[channel][i]);
-                addInt16ToFileData (fileData, sampleAsInt, Endianness::BigEndian);
-            }
-            else if (bitDepth == 24)
-            {
-                int32_t sampleAsIntAgain = (int32_t) (samples[channel][i] * (T)8388608.);
-
-                uint8_t bytes[3];
-                bytes[0] = (uint8_t) (sampleAsIntAgain >> 16) & 0xFF;
-                bytes[1] = (uint8_t) (sampleAsIntAgain >>  8) & 0xFF;
-                bytes[2] = (uint8_t) sampleAsIntAgain & 0xFF;
-
-                fileData.push_back (bytes[0]);
-                fileData.push_back (bytes[1]);
-                fileData.push_back (bytes[2]);
-            }
-            else if (bitDepth == 32)
-            {
-                // write samples as signed integers (no implementation yet for floating point, but looking at WAV implementation should help)
-                int32_t sampleAsInt = (int32_t) (samples[channel][i] * std::numeric_limits<int32_t>::max());
-                addInt32ToFileData (fileData, sampleAsInt, Endianness::BigEndian);
-            }
-            else
-            {
-                assert (false && "Trying to write a file with unsupported bit depth");
-                return false;
-            }
-        }
+        assert (false && "Trying to write a file with unsupported bit depth");
+        return false;
     }
 
     /* iXML CHUNK */
@@ -860,21 +768,36 @@ template <class T> bool AudioFile<T>::saveToAiffFile (std::string filePath)
     return writeDataToFile (fileData, filePath);
 }
 
+template <class T> bool AudioFile<T>::encodeSamples (std::vector<uint8_t>& fileData, bool floatingPoint, Endianness endianness)
+{
+    int numChannels = getNumChannels();
+    int numSamples = getNumSamplesPerChannel();
+    int numBytesPerSample = bitDepth / 8;
+    size_t offset = fileData.size();
+
+    if (bitDepth != 8 && bitDepth != 16 && bitDepth != 24 && bitDepth != 32)
+        return false;
+
+    fileData.resize (offset + (size_t) numSamples * numChannels * numBytesPerSample);
+
+    /* the channels are interleaved directly into the file data, one pass per channel */
+    for (int channel = 0; numSamples > 0 && channel < numChannels; channel++)
+        pcm::encode (samples[channel].data(), numSamples, 1, bitDepth, floatingPoint, endianness == Endianness::BigEndian,
+                     &fileData[offset + channel * numBytesPerSample], numChannels * numBytesPerSample);
+
+    return true;
+}
+
 template <class T> bool AudioFile<T>::writeDataToFile (std::vector<uint8_t>& fileData, std::string filePath)
 {
     std::ofstream outputFile (filePath, std::ios::binary);
 
     if (outputFile.is_open())
     {
-        for (size_t i = 0; i < fileData.size(); i++)
-        {
-            char value = (char) fileData[i];
-            outputFile.write (&value, sizeof (char));
-        }
-
+        outputFile.write ((const char*) fileData.data(), fileData.size());
         outputFile.close();
 
-        return true;
+        return outputFile.good();
     }
 
     return false;
@@ -0,0 +1,57 @@
+#ifndef __bounded_queue_included_3029485716203948571620394857162039485716203948
+#define __bounded_queue_included_3029485716203948571620394857162039485716203948
+
+//=======================================================================================================================================================================================================================
+// blocking multi-producer / multi-consumer queue of a fixed capacity connecting two pipeline stages
+//  - push blocks while the queue is full, so a fast producer cannot run arbitrarily far ahead
+//  - pop blocks while the queue is empty and returns false once the queue is closed and drained
+//=======================================================================================================================================================================================================================
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+template<typename T> struct bounded_queue_t
+{
+    size_t capacity;
+    bool closed = false;
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+
+    bounded_queue_t(size_t capacity)
+        : capacity(capacity) {}
+
+    void push(T&& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return items.size() < capacity; });
+        items.push_back(std::move(item));
+        lock.unlock();
+        not_empty.notify_one();
+    }
+
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty())
+            return false;
+        item = std::move(items.front());
+        items.pop_front();
+        lock.unlock();
+        not_full.notify_one();
+        return true;
+    }
+
+    /* no more items will be pushed, wakes up all the waiting consumers */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+    }
+};
+
+#endif /* __bounded_queue_included_3029485716203948571620394857162039485716203948 */
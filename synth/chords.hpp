@@ -0,0 +1,232 @@
+#ifndef __chords_included_3302918475610293847561029384756102938475610293847561
+#define __chords_included_3302918475610293847561029384756102938475610293847561
+
+//=======================================================================================================================================================================================================================
+// chord sets of the melody generator :: every set is six pitch classes sorted ascending, transposed to start at 0,
+// the sets are grouped into the chord classes offered by the generator, 1 .. CHORD_CLASS_COUNT
+// the groups are concatenated into one flat table at compile time, the index range of every class is derived
+// from the group sizes, and the sets are checked by static_assert -- nothing is maintained by hand
+// a set may appear in a group more than once, that makes it proportionally more likely to be chosen
+//=======================================================================================================================================================================================================================
+
+#include <cstdint>
+
+namespace chords {
+
+static const int CHORD_SIZE = 6;
+
+struct chord_set_t
+{
+    uint8_t notes[CHORD_SIZE];
+
+    constexpr int operator[] (int i) const
+        { return notes[i]; }
+};
+
+static constexpr chord_set_t mix[] =
+{
+    {  0,  1,  3,  5,  6,  8 },
+    {  0,  1,  3,  4,  6,  8 },
+    {  0,  1,  3,  5,  6,  9 },
+    {  0,  2,  3,  5,  6,  9 },
+    {  0,  3,  4,  6,  8, 11 },
+    {  0,  3,  4,  6,  7, 11 },
+    {  0,  1,  3,  5,  6,  9 },
+    {  0,  2,  3,  6,  7, 11 },
+    {  0,  2,  3,  6,  7, 10 },
+    {  0,  1,  3,  4,  6,  9 },
+    {  0,  1,  3,  5,  6,  9 },
+    {  0,  2,  3,  5,  6, 10 },
+    {  0,  1,  3,  5,  6, 10 },
+    {  0,  1,  3,  5,  7,  9 },
+    {  0,  2,  3,  5,  7,  8 },
+    {  0,  2,  3,  6,  7, 10 },
+    {  0,  3,  5,  7,  8, 11 },
+    {  0,  1,  3,  5,  7,  9 },
+    {  0,  2,  3,  7,  8, 11 },
+    {  0,  1,  3,  5,  7,  9 },
+    {  0,  1,  3,  4,  7, 10 },
+    {  0,  2,  3,  6,  7, 10 },
+    {  0,  2,  3,  5,  7, 11 },
+    {  0,  1,  4,  5,  7,  9 },
+    {  0,  2,  4,  5,  7,  8 },
+    {  0,  2,  4,  6,  7, 10 },
+    {  0,  3,  4,  6,  7,  9 },
+    {  0,  4,  5,  7,  8, 11 },
+    {  0,  1,  4,  5,  7,  9 },
+    {  0,  2,  4,  6,  7, 10 },
+    {  0,  2,  4,  7,  8, 11 },
+    {  0,  1,  4,  5,  7,  9 },
+    {  0,  2,  4,  6,  7, 10 },
+    {  0,  2,  4,  5,  7, 11 },
+    {  0,  2,  4,  6,  8,  9 },
+    {  0,  2,  4,  5,  8,  9 },
+    {  0,  3,  4,  6,  8,  9 },
+    {  0,  3,  4,  7,  8, 10 },
+    {  0,  3,  4,  6,  8, 10 },
+    {  0,  1,  4,  6,  8, 10 },
+    {  0,  1,  4,  6,  8,  9 },
+    {  0,  1,  4,  7,  8, 10 },
+    {  0,  2,  4,  7,  8, 10 },
+    {  0,  2,  4,  5,  8, 10 },
+    {  0,  1,  4,  5,  8, 10 },
+    {  0,  2,  4,  5,  8, 11 },
+    {  0,  3,  4,  6,  8, 11 },
+    {  0,  2,  4,  6,  8, 11 },
+};
+
+static constexpr chord_set_t minmin[] =
+{
+    {  0,  2,  3,  5,  6, 11 },
+    {  0,  1,  3,  4,  6, 10 },
+    {  0,  2,  3,  6,  8, 11 },
+    {  0,  1,  3,  6,  7, 10 },
+    {  0,  3,  5,  6,  8, 11 },
+    {  0,  3,  4,  6,  7, 10 },
+    {  0,  2,  3,  5,  6,  8 },
+    {  0,  1,  3,  4,  6,  7 },
+};
+
+static constexpr chord_set_t majmaj[] =
+{
+    {  0,  3,  4,  7,  8, 11 },
+    {  0,  2,  4,  6,  8, 10 },
+    {  0,  1,  4,  5,  8,  9 },
+    {  0,  3,  4,  7,  8, 11 },
+    {  0,  2,  4,  6,  8, 10 },
+    {  0,  1,  4,  5,  8,  9 },
+    {  0,  3,  4,  7,  8, 11 },
+    {  0,  2,  4,  6,  8, 10 },
+    {  0,  1,  4,  5,  8,  9 },
+};
+
+static constexpr chord_set_t durmol[] =
+{
+    {  0,  2,  4,  6,  7, 11 },
+    {  0,  1,  4,  5,  7, 10 },
+    {  0,  3,  4,  7,  8, 11 },
+    {  0,  1,  4,  6,  7,  9 },
+    {  0,  3,  4,  6,  7, 10 },
+    {  0,  2,  4,  5,  7,  9 },
+    {  0,  2,  3,  6,  7,  9 },
+    {  0,  1,  3,  5,  7,  8 },
+    {  0,  1,  3,  6,  7, 10 },
+    {  0,  1,  3,  4,  7,  9 },
+    {  0,  2,  3,  5,  7, 10 },
+    {  0,  3,  4,  7,  8, 11 },
+};
+
+static constexpr chord_set_t durdur[] =
+{
+    {  0,  1,  4,  5,  7,  8 },
+    {  0,  3,  4,  6,  7, 11 },
+    {  0,  2,  4,  5,  7, 10 },
+    {  0,  1,  4,  6,  7, 10 },
+    {  0,  2,  4,  6,  7,  9 },
+};
+
+static constexpr chord_set_t molmol[] =
+{
+    {  0,  1,  3,  4,  7,  8 },
+    {  0,  2,  3,  5,  7,  9 },
+    {  0,  1,  3,  6,  7,  9 },
+    {  0,  1,  3,  5,  7, 10 },
+    {  0,  2,  3,  6,  7, 11 },
+};
+
+struct chord_group_t
+{
+    const char* name;
+    const chord_set_t* sets;
+    int count;
+};
+
+template<int N> constexpr chord_group_t group(const char* name, const chord_set_t (&sets)[N])
+    { return chord_group_t { name, sets, N }; }
+
+/* the order is the chord class numbering of the generator */
+static constexpr chord_group_t groups[] =
+{
+    group("mix",    mix),
+    group("minmin", minmin),
+    group("majmaj", majmaj),
+    group("durmol", durmol),
+    group("durdur", durdur),
+    group("molmol", molmol),
+};
+
+static constexpr int CHORD_CLASS_COUNT = sizeof(groups) / sizeof(chord_group_t);
+
+constexpr int total_sets()
+{
+    int total = 0;
+    for (int c = 0; c < CHORD_CLASS_COUNT; ++c)
+        total += groups[c].count;
+    return total;
+}
+
+static constexpr int CHORD_SET_COUNT = total_sets();
+
+//=======================================================================================================================================================================================================================
+// the flat table :: the sets of class c (0-based) are sets[first[c]] .. sets[first[c + 1] - 1]
+//=======================================================================================================================================================================================================================
+struct chord_table_t
+{
+    chord_set_t sets[CHORD_SET_COUNT];
+    int first[CHORD_CLASS_COUNT + 1];
+
+    constexpr chord_table_t()
+        : sets(), first()
+    {
+        int i = 0;
+        for (int c = 0; c < CHORD_CLASS_COUNT; ++c)
+        {
+            first[c] = i;
+            for (int k = 0; k < groups[c].count; ++k, ++i)
+                for (int n = 0; n < CHORD_SIZE; ++n)
+                    sets[i].notes[n] = groups[c].sets[k].notes[n];
+        }
+        first[CHORD_CLASS_COUNT] = i;
+    }
+
+    constexpr int min_index(int chord_class) const
+        { return first[chord_class - 1]; }
+
+    constexpr int max_index(int chord_class) const
+        { return first[chord_class] - 1; }
+};
+
+static constexpr chord_table_t table;
+
+/* every set starts at 0 and is strictly ascending within the octave, so its notes are sorted and distinct */
+constexpr bool sets_valid()
+{
+    for (int i = 0; i < CHORD_SET_COUNT; ++i)
+    {
+        if (table.sets[i][0] != 0)
+            return false;
+        for (int n = 1; n < CHORD_SIZE; ++n)
+            if ((table.sets[i][n] <= table.sets[i][n - 1]) || (table.sets[i][n] > 11))
+                return false;
+    }
+    return true;
+}
+
+/* the classes are non-empty and their ranges tile the table without gaps or overlaps */
+constexpr bool ranges_valid()
+{
+    if ((table.first[0] != 0) || (table.first[CHORD_CLASS_COUNT] != CHORD_SET_COUNT))
+        return false;
+    for (int c = 1; c <= CHORD_CLASS_COUNT; ++c)
+        if ((table.min_index(c) > table.max_index(c)) || (table.max_index(c) - table.min_index(c) + 1 != groups[c - 1].count))
+            return false;
+    return true;
+}
+
+static_assert(CHORD_CLASS_COUNT == 6, "the generator offers six chord classes");
+static_assert(sets_valid(), "chord sets must be sorted, distinct pitch classes starting at 0");
+static_assert(ranges_valid(), "chord class ranges must tile the flat table");
+
+} /* namespace chords */
+
+#endif /* __chords_included_3302918475610293847561029384756102938475610293847561 */
@@ -0,0 +1,170 @@
+#ifndef __envelope_included_1938475610293847561029384756102938475610293847561029
+#define __envelope_included_1938475610293847561029384756102938475610293847561029
+
+//=======================================================================================================================================================================================================================
+// ADSR envelope generator shared by all the voices
+// every stage is an exponential segment value = base + y, y *= m -- one multiply per sample,
+// stage lengths are counted in samples so a block is split into whole segments without per-sample tests,
+// inside a segment LANES consecutive values are produced from y * m^0 .. y * m^(LANES - 1), which vectorizes
+//  - attack  : rises from the current level towards an overshoot target and reaches 1.0 after attack seconds
+//  - decay   : falls from 1.0 towards the sustain level with the given time constant, until it is within -60 dB of it
+//  - sustain : holds the sustain level until note_off, renewed every SUSTAIN_SAMPLES so no counter can overflow
+//  - release : falls from the current level to -60 dB in release seconds, then the envelope is finished
+//=======================================================================================================================================================================================================================
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+struct adsr_t
+{
+    float attack;                               /* seconds */
+    float decay;                                /* time constant, seconds */
+    float sustain;                              /* level, 0 .. 1 */
+    float release;                              /* seconds to -60 dB */
+};
+
+/* per-sample coefficients of an ADSR for a given sample rate, computed once per instrument, not per note */
+struct envelope_params_t
+{
+    static constexpr float ATTACK_OVERSHOOT = 1.5f;
+    static const int SUSTAIN_SAMPLES = 1 << 20;
+
+    int attack_samples;
+    float attack_m;
+    int decay_samples;
+    float decay_m;
+    float sustain;
+    int release_samples;
+    float release_m;
+
+    envelope_params_t() {}
+    envelope_params_t(const adsr_t& adsr, int sample_rate)
+    {
+        attack_samples = std::max(1, (int) (adsr.attack * sample_rate));
+        attack_m = std::pow(1.0f - 1.0f / ATTACK_OVERSHOOT, 1.0f / attack_samples);                 /* overshoot - overshoot * m^n = 1 */
+        decay_samples = (int) std::min(std::ceil(std::log(1000.0f) * std::max(adsr.decay * sample_rate, 1.0f)), (float) (INT_MAX / 2));   /* the distance to sustain falls by 60 dB */
+        decay_m = std::exp(-1.0f / std::max(adsr.decay * sample_rate, 1.0f));
+        sustain = adsr.sustain;
+        release_samples = std::max(1, (int) (adsr.release * sample_rate));
+        release_m = std::pow(0.001f, 1.0f / release_samples);
+    }
+};
+
+struct envelope_t
+{
+    static const int LANES = 8;
+
+    enum stage_t
+    {
+        ATTACK,
+        DECAY,
+        SUSTAIN,
+        RELEASE,
+        IDLE
+    };
+
+    stage_t stage = IDLE;
+    int remaining = 0;                          /* samples left in the current stage */
+    float base = 0.0f;
+    float y = 0.0f;
+    float m = 0.0f;
+
+    float level() const
+        { return base + y; }
+
+    bool finished() const
+        { return stage == IDLE; }
+
+    void note_on(const envelope_params_t& p)
+    {
+        float l = (stage == IDLE) ? 0.0f : level();
+        stage = ATTACK;
+        remaining = p.attack_samples;
+        base = envelope_params_t::ATTACK_OVERSHOOT;
+        y = l - base;
+        m = p.attack_m;
+    }
+
+    void note_off(const envelope_params_t& p)
+    {
+        if (stage == IDLE)
+            return;
+        stage = RELEASE;
+        remaining = p.release_samples;
+        y = level();
+        base = 0.0f;
+        m = p.release_m;
+    }
+
+    /* writes the next n values of the envelope to out, the tail after the release is filled with zeros */
+    void render(float* out, int n, const envelope_params_t& p)
+    {
+        while (n > 0)
+        {
+            if (stage == IDLE)
+            {
+                std::fill(out, out + n, 0.0f);
+                return;
+            }
+
+            int k = std::min(n, remaining);
+            segment(out, k);
+            out += k;
+            n -= k;
+            remaining -= k;
+
+            if (remaining == 0)
+            {
+                if (stage == ATTACK)
+                {
+                    stage = DECAY;
+                    remaining = p.decay_samples;
+                    base = p.sustain;
+                    y = 1.0f - p.sustain;
+                    m = p.decay_m;
+                }
+                else if (stage == DECAY)
+                {
+                    stage = SUSTAIN;                                                        // the tail of the decay fades on inaudibly
+                    remaining = envelope_params_t::SUSTAIN_SAMPLES;
+                }
+                else if (stage == SUSTAIN)
+                {
+                    remaining = envelope_params_t::SUSTAIN_SAMPLES;
+                    y = 0.0f;                                                               // settled, and no denormals from here on
+                }
+                else if (stage == RELEASE)
+                {
+                    stage = IDLE;
+                    base = y = 0.0f;
+                }
+            }
+        }
+    }
+
+    void segment(float* out, int k)
+    {
+        float mp[LANES];
+        mp[0] = 1.0f;
+        for (int l = 1; l < LANES; ++l)
+            mp[l] = mp[l - 1] * m;
+        const float m_lanes = mp[LANES - 1] * m;
+
+        int i = 0;
+        for (; i + LANES <= k; i += LANES)
+        {
+            for (int l = 0; l < LANES; ++l)
+                out[i + l] = base + y * mp[l];
+            y *= m_lanes;
+        }
+
+        for (; i < k; ++i)
+        {
+            out[i] = base + y;
+            y *= m;
+        }
+    }
+};
+
+#endif /* __envelope_included_1938475610293847561029384756102938475610293847561029 */
@@ -0,0 +1,101 @@
+#ifndef __event_queue_included_7730192847561029384756102938475610293847561029384756
+#define __event_queue_included_7730192847561029384756102938475610293847561029384756
+
+//=======================================================================================================================================================================================================================
+// live note events and the lock-free queue that carries them to the audio render thread
+//  - every event is stamped with clock_us() when it is ingested, the render thread turns the stamp into a sample
+//    offset (see live_synth.hpp)
+//  - event_queue_t is a bounded multi-producer queue -- the keyboard handler and a MIDI input thread may both post --
+//    with a single consumer; every cell carries a sequence number, so push() and pop() are a compare-and-swap on the
+//    position plus a release store, no locks and no allocation
+//  - a full queue drops the event and counts it, the producers never wait for the audio thread
+//=======================================================================================================================================================================================================================
+
+#include <atomic>
+#include <cstdint>
+
+#include "playback_stats.hpp"
+
+struct note_event_t
+{
+    enum type_t : uint8_t
+    {
+        NOTE_ON,
+        NOTE_OFF,
+        CONTROL                                                     /* MIDI controller: key is the controller number, value its value */
+    };
+
+    int64_t time;                                                   /* clock_us() at ingest */
+    uint8_t type;
+    uint8_t channel;
+    uint8_t key;                                                    /* MIDI note number */
+    uint8_t value;                                                  /* velocity */
+
+    static note_event_t make(type_t type, int key, int value, int64_t time = clock_us(), int channel = 0)
+        { return note_event_t { time, (uint8_t) type, (uint8_t) channel, (uint8_t) key, (uint8_t) value }; }
+};
+
+struct event_queue_t
+{
+    static const int SIZE = 1024;                                   /* a power of two */
+    static const int CACHE_LINE = 64;
+
+    struct cell_t
+    {
+        std::atomic<size_t> sequence;
+        note_event_t event;
+    };
+
+    cell_t cells[SIZE];
+    char cells_pad[CACHE_LINE];
+    std::atomic<size_t> tail { 0 };                                 /* the next cell to push into, shared by the producers */
+    char tail_pad[CACHE_LINE];
+    std::atomic<size_t> head { 0 };                                 /* the next cell to pop, owned by the consumer */
+    std::atomic<uint64_t> dropped { 0 };
+
+    event_queue_t()
+    {
+        for (int i = 0; i < SIZE; ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(const note_event_t& event)
+    {
+        size_t position = tail.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell_t& cell = cells[position & (SIZE - 1)];
+            intptr_t diff = (intptr_t) cell.sequence.load(std::memory_order_acquire) - (intptr_t) position;
+            if (diff == 0)
+            {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.event = event;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+                position = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    bool pop(note_event_t& event)
+    {
+        size_t position = head.load(std::memory_order_relaxed);
+        cell_t& cell = cells[position & (SIZE - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != position + 1)
+            return false;
+        event = cell.event;
+        cell.sequence.store(position + SIZE, std::memory_order_release);
+        head.store(position + 1, std::memory_order_relaxed);
+        return true;
+    }
+};
+
+#endif /* __event_queue_included_7730192847561029384756102938475610293847561029384756 */
@@ -0,0 +1,36 @@
+#ifndef __instrument_included_6650192837461029384756102938475610293847561029384
+#define __instrument_included_6650192837461029384756102938475610293847561029384
+
+//=======================================================================================================================================================================================================================
+// additive instruments :: amplitudes and phases of the first HARMONICS partials and the ADSR envelope of the note,
+// the instrument numbers are the ones offered by the generator, 1 .. INSTRUMENT_COUNT
+//=======================================================================================================================================================================================================================
+
+#include <cmath>
+
+#include "envelope.hpp"
+
+struct instrument_t
+{
+    static const int HARMONICS = 4;
+
+    const char* name;
+    float amplitude[HARMONICS];
+    float phase[HARMONICS];
+    adsr_t envelope;
+};
+
+static const instrument_t instruments[] =
+{
+    /*  name             amplitudes                                 phases                                    attack   decay  sustain  release */
+    { "pivanina",    { 16384.0f, 4096.0f, 1024.0f,  512.0f }, { 0.0f, M_PI / 4, M_PI / 2, -M_PI / 4 }, { 0.004f, 0.80f, 0.00f, 0.15f } },
+    { "getarka",     { 12288.0f, 6144.0f, 3072.0f, 1536.0f }, { 0.0f, 0.0f,     M_PI / 4,  M_PI / 2 }, { 0.002f, 0.33f, 0.00f, 0.10f } },
+    { "bzdudka",     { 16384.0f,  512.0f, 4096.0f,  256.0f }, { 0.0f, M_PI / 2, 0.0f,      M_PI / 2 }, { 0.040f, 0.30f, 0.70f, 0.12f } },
+    { "trombon",     { 10240.0f, 7168.0f, 4096.0f, 2048.0f }, { 0.0f, M_PI / 8, M_PI / 4,  M_PI / 2 }, { 0.030f, 0.40f, 0.60f, 0.15f } },
+    { "kontrabzdas", { 18432.0f, 2048.0f,  512.0f,  256.0f }, { 0.0f, M_PI / 2, M_PI,      M_PI / 2 }, { 0.010f, 1.30f, 0.00f, 0.20f } },
+    { "bzdarabzdan", {  8192.0f, 8192.0f, 4096.0f, 4096.0f }, { 0.0f, M_PI,     0.0f,      M_PI     }, { 0.015f, 0.50f, 0.30f, 0.25f } },
+};
+
+static const int INSTRUMENT_COUNT = sizeof(instruments) / sizeof(instrument_t);
+
+#endif /* __instrument_included_6650192837461029384756102938475610293847561029384 */
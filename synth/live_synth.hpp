@@ -0,0 +1,123 @@
+#ifndef __live_synth_included_8840192847561029384756102938475610293847561029384756
+#define __live_synth_included_8840192847561029384756102938475610293847561029384756
+
+//=======================================================================================================================================================================================================================
+// live play :: the render callback of a player that turns queued note events into mixer voices
+//  - an event ingested at time t is scheduled on the stream frame the device plays at t + delay plus the output queue
+//    the player keeps at the time, so every note sounds that long after its key was pressed, whatever the block
+//    boundaries -- the jitter of the render thread's wakeups does not reach the audio; an event too late for that
+//    frame plays at the start of the next block
+//  - the frame -> time mapping is the device position the player publishes in its stats, until the source starts
+//    playing the events are applied at the start of the next block
+//  - the latency from ingest to the played frame is recorded in the stats, so the key-to-sound time is measured
+//  - controllers :: 64 the sustain pedal holds the released keys until it is lifted, 120 all sound off and
+//    123 all notes off release every held voice
+//  - runs on the audio thread :: no allocation, no locks, the queue is lock-free and the voices are reserved
+//=======================================================================================================================================================================================================================
+
+#include <algorithm>
+#include <cstdint>
+
+#include "event_queue.hpp"
+#include "mixer.hpp"
+#include "playback_stats.hpp"
+
+struct live_synth_t
+{
+    mixer_t& mixer;
+    event_queue_t& events;
+    playback_stats_t* stats;                                        /* the device position, 0 -- no scheduling, events apply at once */
+    int64_t delay = 0;                                              /* frames between the ingest of an event and the frame it sounds on, on top of the output queue */
+    int64_t frame = 0;                                              /* the first frame of the next block */
+
+    note_event_t pending;                                           /* popped, but due in a later block */
+    bool held = false;
+
+    bool sustain = false;
+    bool sustained[128] = {};                                       /* keys released while the pedal was down */
+
+    live_synth_t(mixer_t& mixer, event_queue_t& events, playback_stats_t* stats = 0, int64_t delay = 0)
+        : mixer(mixer), events(events), stats(stats), delay(delay)
+    {
+    }
+
+    /* the render callback, the stream never ends */
+    int operator () (float* frames, int n)
+    {
+        for (int done = 0; done < n; )
+        {
+            int k = std::min(n - done, (int) mixer_t::BLOCK_SIZE);
+            schedule(k);
+
+            float* block;
+            k = mixer.render_block(block, k);
+            std::copy(block, block + k * mixer.channels, frames + done * mixer.channels);
+            done += k;
+            frame += k;
+        }
+        return n;
+    }
+
+    /* the frame an event ingested at the given time is due on */
+    int64_t due(int64_t time) const
+    {
+        int64_t t0 = stats ? stats->origin.load(std::memory_order_relaxed) : 0;
+        if (!t0)
+            return frame;
+        return (time - t0) * mixer.sample_rate / 1000000 + delay + stats->queue_frames.load(std::memory_order_relaxed);
+    }
+
+    /* applies the events due within the next k frames at their offsets */
+    void schedule(int k)
+    {
+        while (held || events.pop(pending))
+        {
+            held = true;
+            int64_t at = due(pending.time);
+            if (at >= frame + k)
+                return;
+
+            int offset = (int) std::max<int64_t>(0, at - frame);
+            apply(pending, offset);
+            if (stats)
+                stats->event(pending.time, frame + offset);
+            held = false;
+        }
+    }
+
+    void apply(const note_event_t& event, int offset)
+    {
+        if (event.type == note_event_t::CONTROL)
+            control(event.key, event.value, offset);
+        else if ((event.type == note_event_t::NOTE_ON) && (event.value > 0))
+        {
+            mixer.note_on(event.key, event.value, offset);
+            sustained[event.key & 0x7F] = false;                    // held again, lifting the pedal must not cut it
+        }
+        else if (sustain)
+            sustained[event.key & 0x7F] = true;
+        else
+            mixer.note_off(event.key, offset);
+    }
+
+    void control(int controller, int value, int offset)
+    {
+        if (controller == 64)
+        {
+            sustain = (value >= 64);
+            for (int key = 0; !sustain && (key < 128); ++key)
+                if (sustained[key])
+                {
+                    mixer.note_off(key, offset);
+                    sustained[key] = false;
+                }
+        }
+        else if ((controller == 120) || (controller == 123))
+        {
+            mixer.note_off(-1, offset);
+            std::fill(sustained, sustained + 128, false);
+        }
+    }
+};
+
+#endif /* __live_synth_included_8840192847561029384756102938475610293847561029384756 */
@@ -1,4 +1,6 @@
+#include <climits>
 #include <cstdio>
+#include <cstdlib>
 
 #include "GL/glew.h"
 #include "GLFW/glfw3.h"
@@ -12,18 +14,15 @@
 #include "gl/gl_aux.hpp"
 #include "gl/log.hpp"
 
-#include <AL/al.h>
-#include <AL/alc.h>
-
+#include "al_player.hpp"
+#include "alsa_midi_in.hpp"
+#include "audio_backend.hpp"
 #include "audio_file.hpp"
-
-#ifdef LIBAUDIO
-#include <audio/wave.h>
-#define BACKEND "libaudio"
-#else
-#include <AL/alut.h>
-#define BACKEND "alut"
-#endif
+#include "event_queue.hpp"
+#include "instrument.hpp"
+#include "live_synth.hpp"
+#include "midi_file.hpp"
+#include "mixer.hpp"
 
 static void list_audio_devices(const ALCchar *devices)
 {
@@ -43,25 +42,75 @@ static void list_audio_devices(const ALCchar *devices)
     fprintf(stdout, "----------\n");
 }
 
-void alValidate(const char* msg)
+//=======================================================================================================================================================================================================================
+// playback statistics panel :: device position, underruns and the timing histograms of the player, in milliseconds
+//=======================================================================================================================================================================================================================
+static void plot_histogram(const char* label, const histogram_t& histogram)
 {
-    ALenum error = alGetError();
-    if (error != AL_NO_ERROR)
-    {
-        fprintf(stderr, "%s\n", msg);
-        std::exit(-1);
-    }
+    float counts[histogram_t::BINS];
+    for (int b = 0; b < histogram_t::BINS; ++b)
+        counts[b] = (float) histogram.counts[b].load(std::memory_order_relaxed);
+
+    ImGui::Text("%s :: mean %.2f, p50 %.2f, p99 %.2f, max %.2f ms", label, histogram.mean() / 1000.0, histogram.percentile(0.5) / 1000.0,
+                histogram.percentile(0.99) / 1000.0, histogram.max.load() / 1000.0);
+    ImGui::PushID(label);
+    ImGui::PlotHistogram("", counts, histogram_t::BINS, 0, 0, 0.0f, FLT_MAX, ImVec2(0, 48));
+    ImGui::PopID();
 }
 
-static inline ALenum to_al_format(short channels, short samples)
+static void playback_panel(const al_player_t& player)
 {
-    return (samples == 16) ? (channels > 1 ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16) :
-           (samples == 8 ) ? (channels > 1 ? AL_FORMAT_STEREO8  : AL_FORMAT_MONO8 ) :
-           -1;
+    const playback_stats_t& stats = player.stats;
+    double period = 1000.0 * player.buffer_frames / player.sample_rate;
+
+    ImGui::SetNextWindowSize(ImVec2(512, 384), ImGuiCond_FirstUseEver);
+    ImGui::Begin("Playback", 0);
+
+    ImGui::Text("%s :: %d x %d frames (%d .. %d), buffer period %.2f ms", player.playing() ? "playing" : "stopped", player.depth.load(), player.buffer_frames, player.min_depth, player.max_depth, period);
+    ImGui::Text("queue %.2f ms, depth grown %d times, shrunk %d times", stats.queue_frames.load() * 1000.0 / player.sample_rate, player.grown.load(), player.shrunk.load());
+    ImGui::Text("latency %.2f ms, played %.2f s", stats.latency_us() / 1000.0, (double) stats.played.load() / player.sample_rate);
+    ImGui::Text("underruns :: device %d, render %d", player.underruns.load(), player.late.load());
+    ImGui::Text("render load %.1f%%", 100.0 * stats.render_time.mean() / (1000.0 * period));
+    static const char* memory[] = { "unlocked", "buffers locked", "locked" };
+    rt_status_t render, feeder;
+    if (player.thread_status(render, feeder))
+        ImGui::Text("render thread :: %s %d, CPU %d, feeder :: %s %d, memory %s", render.priority ? "FIFO" : "OTHER", render.priority, render.cpu,
+                    feeder.priority ? "FIFO" : "OTHER", feeder.priority, memory[render.locked]);
+    else
+        ImGui::Text("render thread :: starting");
+
+    ImGui::Separator();
+    plot_histogram("render time", stats.render_time);
+    plot_histogram("output latency", stats.output_latency);
+    plot_histogram("event latency", stats.event_latency);
+
+    ImGui::End();
+}
+
+//=======================================================================================================================================================================================================================
+// computer keyboard as a piano, the tracker layout :: Z S X D C V G B H N J M play C4 .. B4 on the lower rows,
+// Q 2 W 3 E R 5 T 6 Y 7 U I play C5 .. C6 on the upper rows, -1 for the other keys
+//=======================================================================================================================================================================================================================
+static int key_note(int key)
+{
+    static const int lower[] = { GLFW_KEY_Z, GLFW_KEY_S, GLFW_KEY_X, GLFW_KEY_D, GLFW_KEY_C, GLFW_KEY_V, GLFW_KEY_G, GLFW_KEY_B, GLFW_KEY_H, GLFW_KEY_N, GLFW_KEY_J, GLFW_KEY_M };
+    static const int upper[] = { GLFW_KEY_Q, GLFW_KEY_2, GLFW_KEY_W, GLFW_KEY_3, GLFW_KEY_E, GLFW_KEY_R, GLFW_KEY_5, GLFW_KEY_T, GLFW_KEY_6, GLFW_KEY_Y, GLFW_KEY_7, GLFW_KEY_U, GLFW_KEY_I };
+
+    for (int i = 0; i < 12; ++i)
+        if (key == lower[i])
+            return 60 + i;
+    for (int i = 0; i < 13; ++i)
+        if (key == upper[i])
+            return 72 + i;
+    return -1;
 }
 
 struct demo_window_t : public imgui_window_t
 {
+    const al_player_t* player = 0;                                  /* shown in the playback panel when set */
+    const char* audio_error = 0;                                    /* shown in the playback panel instead when the audio did not start */
+    event_queue_t* events = 0;                                      /* the keyboard plays into it when set */
+
     demo_window_t(const char* title, int glfw_samples, int version_major, int version_minor, int res_x, int res_y, bool fullscreen = true)
         : imgui_window_t(title, glfw_samples, version_major, version_minor, res_x, res_y, fullscreen, true /*, true */)
     {
@@ -73,6 +122,10 @@ struct demo_window_t : public imgui_window_t
     //===================================================================================================================================================================================================================
     void on_key(int key, int scancode, int action, int mods) override
     {
+        int note = key_note(key);
+        if (!events || (note < 0) || (action == GLFW_REPEAT) || ImGui::GetIO().WantCaptureKeyboard)
+            return;
+        events->push(note_event_t::make((action == GLFW_PRESS) ? note_event_t::NOTE_ON : note_event_t::NOTE_OFF, note, 100));
     }
 
     void on_mouse_move() override
@@ -138,151 +191,192 @@ struct demo_window_t : public imgui_window_t
 
         ImGui::End();
 
+        if (audio_error)
+        {
+            ImGui::Begin("Playback", 0);
+            ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", audio_error);
+            ImGui::End();
+        }
+        else if (player)
+            playback_panel(*player);
+
         ImGui::ShowDemoWindow();
     }
 };
 
-int play_music(int argc, char **argv)
+//=======================================================================================================================================================================================================================
+// hands the real-time options to an OpenAL backend's player, with the mixer voices as memory to lock -- call it after
+// the mixer has reserved them in begin() or begin_live(); the other backends run their thread as it is
+//=======================================================================================================================================================================================================================
+static void set_realtime(audio_backend_t& backend, const mixer_t& mixer, const rt_options_t& rt)
 {
-    const ALCchar *devices;
-    const ALCchar *defaultDeviceName = argv[1];
-    int ret;
-#ifdef LIBAUDIO
-    WaveInfo *wave;
-#endif
-    char *bufferData;
-    ALCdevice *device;
-    ALvoid *data;
-    ALCcontext *context;
-    ALsizei size, freq;
-    ALenum format;
-    ALuint buffer, source;
-    ALfloat listenerOri[] = { 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f };
-    ALboolean loop = AL_FALSE;
-    ALCenum error;
-
-    fprintf(stdout, "Using " BACKEND " as audio backend\n");
-
-    ALboolean enumeration = alcIsExtensionPresent(NULL, "ALC_ENUMERATION_EXT");
-    if (enumeration == AL_FALSE)
-        fprintf(stderr, "enumeration extension not available\n");
-
-    list_audio_devices(alcGetString(NULL, ALC_DEVICE_SPECIFIER));
-
-    if (!defaultDeviceName)
-        defaultDeviceName = alcGetString(NULL, ALC_DEFAULT_DEVICE_SPECIFIER);
-
-    device = alcOpenDevice(defaultDeviceName);
-    if (!device) {
-        fprintf(stderr, "unable to open default device\n");
-        return -1;
-    }
+    openal_backend_t* openal = dynamic_cast<openal_backend_t*>(&backend);
+    if (!openal)
+        return;
+    openal->player.rt_options = rt;
+    openal->player.regions.assign(1, std::make_pair((const void*) mixer.voices.data(), mixer.voices.capacity() * sizeof(mixer.voices[0])));
+}
 
-    fprintf(stdout, "Device: %s\n", alcGetString(device, ALC_DEVICE_SPECIFIER));
+//=======================================================================================================================================================================================================================
+// streams the score through the backend, the mixer renders on the backend's thread ahead of the output
+//=======================================================================================================================================================================================================================
+bool start_music(audio_backend_t& backend, mixer_t& mixer, const score_t& score, const instrument_t& instrument, const rt_options_t& rt = rt_options_t())
+{
+    mixer.channels = backend.channels;
+    mixer.begin(score, instrument);
+    set_realtime(backend, mixer, rt);
+    return backend.start([&mixer](float* frames, int n)
+    {
+        int done = 0;
+        float* block;
+        int k;
+        while ((done < n) && ((k = mixer.render_block(block, n - done)) > 0))
+        {
+            std::copy(block, block + k * mixer.channels, frames + done * mixer.channels);
+            done += k;
+        }
+        return done;
+    });
+}
 
-    alGetError();
+/* the text output goes to stderr when stdout carries the audio */
+static FILE* console(const char* backend_name)
+{
+    return (std::strcmp(backend_name, "-") == 0) ? stderr : stdout;
+}
 
-    context = alcCreateContext(device, NULL);
-    if (!alcMakeContextCurrent(context)) {
-        fprintf(stderr, "failed to make default context\n");
-        return -1;
-    }
-    alValidate("make default context");
-
-    /* set orientation */
-    alListener3f(AL_POSITION, 0, 0, 1.0f);
-    alValidate("listener position");
-    alListener3f(AL_VELOCITY, 0, 0, 0);
-    alValidate("listener velocity");
-    alListenerfv(AL_ORIENTATION, listenerOri);
-    alValidate("listener orientation");
-
-    alGenSources((ALuint)1, &source);
-    alValidate("source generation");
-
-    alSourcef(source, AL_PITCH, 1);
-    alValidate("source pitch");
-    alSourcef(source, AL_GAIN, 1);
-    alValidate("source gain");
-    alSource3f(source, AL_POSITION, 0, 0, 0);
-    alValidate("source position");
-    alSource3f(source, AL_VELOCITY, 0, 0, 0);
-    alValidate("source velocity");
-    alSourcei(source, AL_LOOPING, AL_FALSE);
-    alValidate("source looping");
-
-    alGenBuffers(1, &buffer);
-    alValidate("buffer generation");
-
-#ifdef LIBAUDIO
-    /* load data */
-    wave = WaveOpenFileForReading("test.wav");
-    if (!wave)
+/* plays the score through the named backend (see open_backend) and returns when it is over */
+int play_music(const char* backend_name, const score_t& score, const rt_options_t& rt = rt_options_t(), const instrument_t& instrument = instruments[0], int sample_rate = 44100)
+{
+    if (std::strncmp(backend_name, "openal", 6) == 0)
     {
-        fprintf(stderr, "failed to read wave file\n");
-        return -1;
+        if (alcIsExtensionPresent(NULL, "ALC_ENUMERATION_EXT") == AL_FALSE)
+            fprintf(stderr, "enumeration extension not available\n");
+        else
+            list_audio_devices(alcGetString(NULL, ALC_DEVICE_SPECIFIER));
     }
 
-    ret = WaveSeekFile(0, wave);
-    if (ret)
-    {
-        fprintf(stderr, "failed to seek wave file\n");
+    mixer_t mixer(sample_rate);
+    std::unique_ptr<audio_backend_t> backend = open_backend(backend_name, sample_rate);
+    if (!backend)
         return -1;
-    }
+    fprintf(console(backend_name), "Using the %s audio backend\n", backend->name());
 
-    bufferData = malloc(wave->dataSize);
-    if (!bufferData)
+    if (!start_music(*backend, mixer, score, instrument, rt))
     {
-        perror("malloc");
+        fprintf(stderr, "the %s audio backend failed to start\n", backend->name());
         return -1;
     }
+    backend->wait();
 
-    ret = WaveReadFile(bufferData, wave->dataSize, wave);
-    if (ret != wave->dataSize)
+    fprintf(console(backend_name), "%.2f s of audio, %.1fx real time\n", (double) backend->frames() / sample_rate, backend->real_time_factor());
+    openal_backend_t* openal = dynamic_cast<openal_backend_t*>(backend.get());
+    if (openal)
     {
-        fprintf(stderr, "short read: %d, want: %d\n", ret, wave->dataSize);
-        return -1;
+        const al_player_t& player = openal->player;
+        fprintf(stdout, "render time p99 %.2f ms, output latency p50 %.2f ms, start latency %.2f ms\n", player.stats.render_time.percentile(0.99) / 1000.0,
+                player.stats.output_latency.percentile(0.5) / 1000.0, player.stats.event_latency.max.load() / 1000.0);
+        if ((player.underruns > 0) || (player.late > 0))
+            fprintf(stderr, "%d buffer underruns, %d render underruns\n", player.underruns.load(), player.late.load());
     }
+    return 0;
+}
 
-    alBufferData(buffer, to_al_format(wave->channels, wave->bitsPerSample),
-            bufferData, wave->dataSize, wave->sampleRate);
-    alValidate("failed to load buffer data");
-#else
-    alutLoadWAVFile((ALbyte*) "wav/test.wav", &format, &data, &size, &freq, &loop);
-    alValidate("loading wav file");
-
-    alBufferData(buffer, format, data, size, freq);
-    alValidate("buffer copy");
-#endif
-
-    alSourcei(source, AL_BUFFER, buffer);
-    alValidate("buffer binding");
-
-    alSourcePlay(source);
-    alValidate("source playing");
+static const char* USAGE = "usage: msynth [--backend openal|openal:DEVICE|null|FILE] [--headless] [--midi-in [CLIENT:PORT]] [--rt-priority N] [--cpu N] [--mlock] [FILE.mid]\n";
 
-    ALint source_state = AL_PLAYING;
+/* the whole argument is a decimal integer */
+static bool parse_int(const char* arg, int& value)
+{
+    char* end;
+    long v = std::strtol(arg, &end, 10);
+    if ((end == arg) || (*end != 0) || (v < INT_MIN) || (v > INT_MAX))
+        return false;
+    value = (int) v;
+    return true;
+}
 
-    while (source_state == AL_PLAYING)
+//=======================================================================================================================================================================================================================
+// msynth [--backend openal|openal:DEVICE|null|FILE] [--headless] [--midi-in [CLIENT:PORT]] [--rt-priority N] [--cpu N] [--mlock] [FILE.mid]
+// the MIDI file is streamed through the backend while the window runs, --headless plays it without a window
+// --midi-in opens an ALSA sequencer input port for live play, subscribed to CLIENT:PORT if one is given, so it takes
+// no MIDI file
+// --rt-priority runs the OpenAL render thread with SCHED_FIFO priority N, --cpu pins it to core N, --mlock locks the
+// memory, each is dropped with a message if the system refuses it (see rt_thread.hpp)
+//=======================================================================================================================================================================================================================
+int main(int argc, char **argv)
+{
+    const char* midi_name = 0;
+    const char* backend_name = "openal";
+    const char* midi_source = 0;
+    bool midi_in = false;
+    bool headless = false;
+    rt_options_t rt;
+    for (int i = 1; i < argc; ++i)
     {
-        alGetSourcei(source, AL_SOURCE_STATE, &source_state);
-        alValidate("source state get");
+        const char* flag = argv[i];
+        if (std::strcmp(flag, "--headless") == 0)
+            headless = true;
+        else if (std::strcmp(flag, "--mlock") == 0)
+            rt.lock_memory = true;
+        else if (std::strcmp(flag, "--midi-in") == 0)
+        {
+            midi_in = true;
+            if ((i + 1 < argc) && std::strchr(argv[i + 1], ':'))
+                midi_source = argv[++i];
+        }
+        else if ((std::strcmp(flag, "--backend") == 0) || (std::strcmp(flag, "--rt-priority") == 0) || (std::strcmp(flag, "--cpu") == 0))
+        {
+            if (i + 1 == argc)
+            {
+                fprintf(stderr, "missing value for %s\n%s", flag, USAGE);
+                return 1;
+            }
+            const char* arg = argv[++i];
+            bool ok = true;
+            if (std::strcmp(flag, "--backend") == 0)
+                backend_name = arg;
+            else if (std::strcmp(flag, "--rt-priority") == 0)
+                ok = parse_int(arg, rt.priority) && (rt.priority >= 0) && (rt.priority <= 99);
+            else
+                ok = parse_int(arg, rt.cpu) && (rt.cpu >= 0);
+            if (!ok)
+            {
+                fprintf(stderr, "invalid value for %s : %s\n", flag, arg);
+                return 1;
+            }
+        }
+        else if ((flag[0] == '-') && (flag[1] != 0))
+        {
+            fprintf(stderr, "unknown flag %s\n%s", flag, USAGE);
+            return 1;
+        }
+        else if (midi_name)
+        {
+            fprintf(stderr, "more than one MIDI file : %s and %s\n%s", midi_name, flag, USAGE);
+            return 1;
+        }
+        else
+            midi_name = flag;
     }
 
-    /* exit context */
-    alDeleteSources(1, &source);
-    alDeleteBuffers(1, &buffer);
-    device = alcGetContextsDevice(context);
-    alcMakeContextCurrent(NULL);
-    alcDestroyContext(context);
-    alcCloseDevice(device);
-
-    return 0;
-}
+    if (midi_in && midi_name)
+    {
+        fprintf(stderr, "--midi-in plays live, it cannot be combined with the MIDI file %s\n%s", midi_name, USAGE);
+        return 1;
+    }
 
-int main(int argc, char **argv)
-{
-    //play_music(argc, argv);
+    if (headless)
+    {
+        score_t score;
+        if (!midi_name)
+        {
+            fprintf(stderr, "--headless needs a MIDI file\n%s", USAGE);
+            return 1;
+        }
+        if (!load_midi(midi_name, score))
+            return 1;
+        return play_music(backend_name, score, rt);
+    }
 
     //===================================================================================================================================================================================================================
     // initialize GLFW library
@@ -358,6 +452,62 @@ int main(int argc, char **argv)
     glm::vec2 scale = glm::vec2(2.0f / res_x, 1.0);
     glm::vec2 shift = glm::vec2(-1.0f + float(margin_x) / res_x, 0.0);
 
+    //===================================================================================================================================================================================================================
+    // a MIDI file given on the command line is streamed through the backend while the window runs, without one the
+    // keyboard plays live through small buffers :: 3 x 64 frames queued to begin with, 2 to 4 as the player adapts the
+    // depth to the load, 64 rendered ahead, every note is scheduled 2 buffers after its key event plus the queue --
+    // 5 buffers (7.3 ms) at the start, at most 6 (8.7 ms) once the queue has grown -- the cap keeps a key under 10 ms
+    // the backend is declared last so that its thread is stopped before the mixer and the score go away
+    //===================================================================================================================================================================================================================
+    const int live_frames = 64;
+    const int live_buffers = 3;
+    const int live_min_buffers = 2;
+    const int live_max_buffers = 4;
+
+    mixer_t mixer(44100);
+    score_t score;
+    event_queue_t events;
+    live_synth_t live(mixer, events);
+    std::unique_ptr<audio_backend_t> backend;
+    if (midi_name)
+    {
+        if (!load_midi(midi_name, score))
+            window.audio_error = "unable to load the MIDI file";
+        else if (!(backend = open_backend(backend_name, 44100)))
+            window.audio_error = "unable to open the audio backend";
+        else if (!start_music(*backend, mixer, score, instruments[0], rt))
+            window.audio_error = "the audio backend failed to start";
+    }
+    else if ((backend = open_backend(backend_name, 44100, 1, live_frames, live_buffers)) && dynamic_cast<openal_backend_t*>(backend.get()))
+    {
+        al_player_t& player = dynamic_cast<openal_backend_t*>(backend.get())->player;
+        player.lead = live_frames;
+        player.adapt(live_min_buffers, live_max_buffers);
+        mixer.begin_live(instruments[0]);
+        set_realtime(*backend, mixer, rt);
+        live.stats = &player.stats;
+        live.delay = 2 * live_frames;
+        if (backend->start(std::ref(live)))
+            window.events = &events;
+        else
+            window.audio_error = "the audio backend failed to start, no live play";
+    }
+
+#ifdef HAVE_ALSA
+    alsa_midi_in_t midi_input;
+    if (midi_in && window.events)
+        midi_input.open(events, midi_source);
+    else if (midi_in)
+        fprintf(stderr, "live play needs the openal backend, no MIDI input\n");
+#else
+    if (midi_in)
+        fprintf(stderr, "built without ALSA, no MIDI input\n");
+#endif
+
+    openal_backend_t* openal = dynamic_cast<openal_backend_t*>(backend.get());
+    if (openal)
+        window.player = &openal->player;
+
     //===================================================================================================================================================================================================================
     // main loop begin
     //===================================================================================================================================================================================================================
@@ -0,0 +1,158 @@
+#ifndef __melody_hash_included_8830192847561029384756102938475610293847561029384
+#define __melody_hash_included_8830192847561029384756102938475610293847561029384
+
+//=======================================================================================================================================================================================================================
+// melody fingerprints for batch deduplication
+//  - melody_hash_t is fed note by note while the generator produces them: a 64-bit FNV-1a hash of the whole sequence
+//    for exact duplicates and, optionally, a MinHash signature of its n-grams for near duplicates
+//  - melody_filter_t remembers the accepted melodies and rejects a new one if it was seen before or if its estimated
+//    n-gram Jaccard similarity to an accepted melody reaches the threshold; candidates are found by LSH banding of the
+//    signature, so a batch is not compared pairwise -- a pair at similarity s shares a band of r rows out of b with
+//    probability 1 - (1 - s^r)^b, set_threshold() picks the longest bands that still find MIN_RECALL of the pairs at
+//    the threshold, which puts the inflection point of that S-curve well below it
+// a note is identified by its pitch and duration, the start time follows from the sequence
+//=======================================================================================================================================================================================================================
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "score.hpp"
+
+inline uint64_t mix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+struct melody_hash_t
+{
+    static const int NGRAM = 3;
+    static const int SIGNATURE = 64;
+
+    typedef std::array<uint64_t, SIGNATURE> signature_t;
+
+    bool minhash = false;                       /* the signature costs SIGNATURE hashes per note, only computed on request */
+    uint64_t hash;
+    uint64_t tokens[NGRAM];                     /* the last NGRAM notes, most recent first */
+    int count;
+    signature_t signature;
+
+    void reset()
+    {
+        hash = 0xCBF29CE484222325ull;
+        count = 0;
+        signature.fill(UINT64_MAX);
+    }
+
+    void add(const note_t& note)
+    {
+        uint32_t duration;
+        std::memcpy(&duration, &note.duration, 4);
+        uint64_t token = ((uint64_t) duration << 32) | ((uint32_t) (uint16_t) note.octave << 8) | (uint8_t) note.note;
+
+        for (int i = 0; i < 8; ++i)
+            hash = (hash ^ ((token >> (8 * i)) & 0xFF)) * 0x100000001B3ull;
+
+        if (!minhash)
+            return;
+
+        for (int i = NGRAM - 1; i > 0; --i)
+            tokens[i] = tokens[i - 1];
+        tokens[0] = token;
+        ++count;
+
+        /* the gram ending at this note, the leading ones are shorter so that short melodies get a signature too */
+        uint64_t gram = mix64(tokens[0]);
+        for (int n = 1; n < std::min(count, (int) NGRAM); ++n)
+            gram = mix64(gram ^ tokens[n]);
+        insert(gram);
+    }
+
+    void insert(uint64_t gram)
+    {
+        for (int i = 0; i < SIGNATURE; ++i)
+            signature[i] = std::min(signature[i], mix64(gram + (uint64_t) i * 0xD1B54A32D192ED03ull));
+    }
+
+    static float similarity(const signature_t& a, const signature_t& b)
+    {
+        int same = 0;
+        for (int i = 0; i < SIGNATURE; ++i)
+            same += (a[i] == b[i]);
+        return (float) same / SIGNATURE;
+    }
+};
+
+struct melody_filter_t
+{
+    static constexpr double MIN_RECALL = 0.99;
+
+    float threshold = 0.0f;                     /* 0 -- exact duplicates only */
+    int rows = 1;                               /* signature values per band */
+    int bands = melody_hash_t::SIGNATURE;
+    std::unordered_set<uint64_t> seen;
+    std::vector<melody_hash_t::signature_t> signatures;
+    std::vector<std::unordered_map<uint64_t, std::vector<int>>> buckets;
+    std::vector<int> candidates;
+
+    /* the similarity threshold and the banding for it, call before the first accept() */
+    void set_threshold(float threshold)
+    {
+        this->threshold = threshold;
+        rows = 1;
+        for (int r = 2; (r <= melody_hash_t::SIGNATURE) && (threshold > 0.0f); r *= 2)
+            if (1.0 - std::pow(1.0 - std::pow((double) threshold, r), melody_hash_t::SIGNATURE / r) >= MIN_RECALL)
+                rows = r;
+        bands = melody_hash_t::SIGNATURE / rows;
+        buckets.assign(bands, std::unordered_map<uint64_t, std::vector<int>>());
+    }
+
+    uint64_t band_key(const melody_hash_t::signature_t& s, int band) const
+    {
+        uint64_t key = (uint64_t) band;
+        for (int r = 0; r < rows; ++r)
+            key = mix64(key ^ s[band * rows + r]);
+        return key;
+    }
+
+    /* remembers the melody and returns true if it is new enough to be rendered */
+    bool accept(const melody_hash_t& melody)
+    {
+        if (seen.count(melody.hash))
+            return false;
+
+        if (threshold > 0.0f)
+        {
+            candidates.clear();
+            for (int b = 0; b < bands; ++b)
+            {
+                auto it = buckets[b].find(band_key(melody.signature, b));
+                if (it != buckets[b].end())
+                    candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+            }
+            std::sort(candidates.begin(), candidates.end());                                // a close pair shares many of the bands
+            candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+            for (int c : candidates)
+                if (melody_hash_t::similarity(melody.signature, signatures[c]) >= threshold)
+                    return false;
+
+            int index = (int) signatures.size();
+            signatures.push_back(melody.signature);
+            for (int b = 0; b < bands; ++b)
+                buckets[b][band_key(melody.signature, b)].push_back(index);
+        }
+
+        seen.insert(melody.hash);
+        return true;
+    }
+};
+
+#endif /* __melody_hash_included_8830192847561029384756102938475610293847561029384 */
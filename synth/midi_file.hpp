@@ -0,0 +1,464 @@
+#ifndef __midi_file_included_2293847561029384756102938475610293847561029384756102
+#define __midi_file_included_2293847561029384756102938475610293847561029384756102
+
+//=======================================================================================================================================================================================================================
+// Standard MIDI File import and export
+// import :: format 0 and 1 files, any number of tracks, tempo changes and SMPTE time division
+// the file is memory mapped and parsed in place in two passes -- the first one counts the notes and collects the
+// tempo map, the second one streams the note events straight into a score reserved to the exact size, so there is
+// no allocation per event
+//  - a note lasts from its note-on to the matching note-off (or note-on with velocity 0), a retriggered key ends the
+//    sounding note first, notes still held at the end of their track end there
+//  - the percussion channel 10 is skipped, the score is rendered with pitched instruments
+//  - times are converted to whole notes of whole_note seconds, the duration the mixer renders a whole note with
+// export :: a format 0 file with one tempo matching whole_note, running status and note-on velocity 0 as note-off,
+// an optional text event carries the description of how the score was made -- a generated melody takes a few hundred bytes
+//  - a note that overlaps a sounding note of the same key -- a harmony note under the melody -- goes to the next free
+//    channel, so neither note-off ends the other and the import gives the notes back with their own durations
+//=======================================================================================================================================================================================================================
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pitch.hpp"
+#include "score.hpp"
+
+struct mapped_file_t
+{
+    const uint8_t* data = 0;
+    size_t size = 0;
+
+    bool open(const std::string& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if ((fstat(fd, &st) != 0) || (st.st_size == 0))
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void* p = mmap(0, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+            return false;
+
+        madvise(p, (size_t) st.st_size, MADV_SEQUENTIAL);
+        data = (const uint8_t*) p;
+        size = (size_t) st.st_size;
+        return true;
+    }
+
+    ~mapped_file_t()
+    {
+        if (data)
+            munmap((void*) data, size);
+    }
+};
+
+namespace midi {
+
+static const int PERCUSSION_CHANNEL = 9;
+
+/* bounds checked big-endian reader, reading past the end yields zeros and clears ok */
+struct reader_t
+{
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok = true;
+
+    reader_t(const uint8_t* begin, const uint8_t* end) : p(begin), end(end) {}
+
+    bool done() const
+        { return p >= end; }
+
+    uint8_t byte()
+    {
+        if (p < end)
+            return *p++;
+        ok = false;
+        return 0;
+    }
+
+    uint32_t be(int n)
+    {
+        uint32_t v = 0;
+        for (int i = 0; i < n; ++i)
+            v = (v << 8) | byte();
+        return v;
+    }
+
+    /* variable length quantity, at most 4 bytes */
+    uint32_t vlq()
+    {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            uint8_t b = byte();
+            v = (v << 7) | (b & 0x7F);
+            if ((b & 0x80) == 0)
+                return v;
+        }
+        ok = false;
+        return v;
+    }
+
+    void skip(uint32_t n)
+    {
+        if ((size_t) (end - p) < n)
+        {
+            p = end;
+            ok = false;
+        }
+        else
+            p += n;
+    }
+};
+
+struct tempo_t
+{
+    uint32_t tick;
+    uint32_t usec_per_quarter;
+    double seconds;                             /* time of the change, filled in once the map is sorted */
+};
+
+//=======================================================================================================================================================================================================================
+// walks the events of one track and calls on_event(tick, status, data1, data2) for every channel message and
+// on_tempo(tick, usec_per_quarter) for every tempo change, returns the tick of the last event or -1 on a broken track
+//=======================================================================================================================================================================================================================
+template<typename event_f, typename tempo_f> int64_t walk_track(reader_t r, event_f on_event, tempo_f on_tempo)
+{
+    int64_t tick = 0;
+    uint8_t running = 0;
+
+    while (!r.done() && r.ok)
+    {
+        tick += r.vlq();
+        uint8_t status = r.byte();
+
+        if (status == 0xFF)
+        {
+            uint8_t type = r.byte();
+            uint32_t length = r.vlq();
+            if ((type == 0x51) && (length == 3))
+                on_tempo(tick, r.be(3));
+            else
+                r.skip(length);
+            if (type == 0x2F)
+                break;
+            continue;
+        }
+        if ((status == 0xF0) || (status == 0xF7))
+        {
+            r.skip(r.vlq());
+            continue;
+        }
+
+        uint8_t data1;
+        if (status < 0x80)
+        {
+            if (running == 0)
+                return -1;
+            data1 = status;
+            status = running;
+        }
+        else
+        {
+            running = status;
+            data1 = r.byte();
+        }
+
+        uint8_t kind = status & 0xF0;
+        uint8_t data2 = ((kind == 0xC0) || (kind == 0xD0)) ? 0 : r.byte();
+        on_event(tick, status, data1, data2);
+    }
+    return r.ok ? tick : -1;
+}
+
+/* tick to seconds through the tempo map, the cursor only moves forward as the ticks of a track grow */
+struct tick_clock_t
+{
+    const std::vector<tempo_t>& tempo;
+    double seconds_per_tick;                    /* SMPTE files have a fixed tick length */
+    int division;
+    size_t cursor = 0;
+
+    double seconds(int64_t tick)
+    {
+        if (seconds_per_tick > 0.0)
+            return tick * seconds_per_tick;
+        while ((cursor + 1 < tempo.size()) && (tempo[cursor + 1].tick <= tick))
+            ++cursor;
+        const tempo_t& t = tempo[cursor];
+        return t.seconds + (tick - t.tick) * (t.usec_per_quarter * 1e-6 / division);
+    }
+};
+
+} /* namespace midi */
+
+//=======================================================================================================================================================================================================================
+// loads the notes of a Standard MIDI File into score, sorted by the start time, returns false and reports on stderr if
+// the file cannot be read or is not a valid SMF
+//=======================================================================================================================================================================================================================
+inline bool load_midi(const std::string& path, score_t& score, float whole_note = 2.0f)
+{
+    mapped_file_t file;
+    if (!file.open(path))
+    {
+        fprintf(stderr, "cannot map %s\n", path.c_str());
+        return false;
+    }
+
+    midi::reader_t header(file.data, file.data + file.size);
+    if ((header.be(4) != 0x4D546864) || !header.ok)                                          // "MThd"
+    {
+        fprintf(stderr, "%s is not a MIDI file\n", path.c_str());
+        return false;
+    }
+    uint32_t header_size = header.be(4);
+    int format = header.be(2);
+    int track_count = header.be(2);
+    int16_t division = (int16_t) header.be(2);
+    header.skip(header_size - 6);
+    if (!header.ok || (header_size < 6) || (format > 1) || (division == 0))
+    {
+        fprintf(stderr, "%s :: unsupported MIDI header (format %d)\n", path.c_str(), format);
+        return false;
+    }
+
+    /* the track chunks, unknown chunks are skipped */
+    std::vector<midi::reader_t> tracks;
+    tracks.reserve(track_count);
+    while (!header.done() && header.ok)
+    {
+        uint32_t id = header.be(4);
+        uint32_t size = header.be(4);
+        const uint8_t* begin = header.p;
+        header.skip(size);
+        if (!header.ok)
+        {
+            fprintf(stderr, "%s :: truncated chunk\n", path.c_str());
+            return false;
+        }
+        if (id == 0x4D54726B)                                                                // "MTrk"
+            tracks.push_back(midi::reader_t(begin, begin + size));
+    }
+
+    /* pass 1 :: note count and tempo map */
+    size_t notes = 0;
+    std::vector<midi::tempo_t> tempo;
+    tempo.push_back(midi::tempo_t { 0, 500000, 0.0 });                                       // 120 bpm until the first tempo event
+    for (const midi::reader_t& track : tracks)
+    {
+        int64_t end = midi::walk_track(track,
+            [&](int64_t, uint8_t status, uint8_t, uint8_t velocity)
+            {
+                if (((status & 0xF0) == 0x90) && (velocity > 0) && ((status & 0x0F) != midi::PERCUSSION_CHANNEL))
+                    ++notes;
+            },
+            [&](int64_t tick, uint32_t usec)
+                { tempo.push_back(midi::tempo_t { (uint32_t) tick, usec, 0.0 }); });
+        if (end < 0)
+        {
+            fprintf(stderr, "%s :: broken track\n", path.c_str());
+            return false;
+        }
+    }
+
+    std::stable_sort(tempo.begin(), tempo.end(), [](const midi::tempo_t& a, const midi::tempo_t& b) { return a.tick < b.tick; });
+    for (size_t i = 1; i < tempo.size(); ++i)
+        tempo[i].seconds = tempo[i - 1].seconds + (tempo[i].tick - tempo[i - 1].tick) * (tempo[i - 1].usec_per_quarter * 1e-6 / division);
+
+    double smpte = 0.0;
+    if (division < 0)
+        smpte = 1.0 / ((-(division >> 8)) * (division & 0xFF));                              // frames per second * ticks per frame
+
+    /* pass 2 :: the notes */
+    score.clear();
+    score.reserve(notes);
+    const float scale = 1.0f / whole_note;
+    int pending[16][128];
+
+    for (const midi::reader_t& track : tracks)
+    {
+        midi::tick_clock_t clock { tempo, smpte, division };
+        std::fill(&pending[0][0], &pending[0][0] + 16 * 128, -1);
+
+        auto finish = [&](int channel, int key, float time)
+        {
+            int& index = pending[channel][key];
+            if (index >= 0)
+            {
+                score[index].duration = std::max(0.0f, time - score[index].start);
+                index = -1;
+            }
+        };
+
+        int64_t end = midi::walk_track(track,
+            [&](int64_t tick, uint8_t status, uint8_t key, uint8_t velocity)
+            {
+                int channel = status & 0x0F;
+                int kind = status & 0xF0;
+                if (((kind != 0x80) && (kind != 0x90)) || (channel == midi::PERCUSSION_CHANNEL) || (key > 127))
+                    return;
+
+                float time = (float) clock.seconds(tick) * scale;
+                finish(channel, key, time);
+                if ((kind == 0x90) && (velocity > 0))
+                {
+                    pending[channel][key] = (int) score.size();
+                    score.push_back(note_t(time, 0.0f, key / 12 - 1, key % 12, velocity));
+                }
+            },
+            [](int64_t, uint32_t) {});
+
+        float time = (float) clock.seconds(end) * scale;
+        for (int channel = 0; channel < 16; ++channel)
+            for (int key = 0; key < 128; ++key)
+                finish(channel, key, time);
+    }
+
+    std::stable_sort(score.begin(), score.end(), [](const note_t& a, const note_t& b) { return a.start < b.start; });
+    return true;
+}
+
+namespace midi {
+
+static const int EXPORT_DIVISION = 480;         /* ticks per quarter note */
+
+struct event_t
+{
+    uint32_t tick;
+    uint8_t channel;
+    uint8_t key;
+    uint8_t velocity;                           /* 0 -- note-off */
+};
+
+inline void put_vlq(std::vector<uint8_t>& out, uint32_t v)
+{
+    uint8_t b[5];
+    int n = 0;
+    do
+    {
+        b[n++] = (uint8_t) (v & 0x7F);
+        v >>= 7;
+    }
+    while (v);
+    while (n > 1)
+        out.push_back(b[--n] | 0x80);
+    out.push_back(b[0]);
+}
+
+inline void put_be(std::vector<uint8_t>& out, uint32_t v, int n)
+{
+    for (int i = n - 1; i >= 0; --i)
+        out.push_back((uint8_t) (v >> (8 * i)));
+}
+
+} /* namespace midi */
+
+//=======================================================================================================================================================================================================================
+// writes the score as a format 0 Standard MIDI File on channel 1, and the channels after it for notes overlapping
+// the same key, notes outside the MIDI range are dropped, notes shorter than a tick last one tick
+// returns false and reports on stderr if the file cannot be written
+//=======================================================================================================================================================================================================================
+inline bool save_midi(const std::string& path, const score_t& score, const std::string& text = "", float whole_note = 2.0f)
+{
+    const double ticks_per_whole = 4.0 * midi::EXPORT_DIVISION;
+
+    std::vector<size_t> order(score.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&score](size_t a, size_t b) { return score[a].start < score[b].start; });
+
+    std::vector<midi::event_t> events;
+    events.reserve(2 * score.size());
+    std::vector<uint32_t> busy(16 * 128, 0);                                                 // the tick each channel's key is free again
+    for (size_t i : order)
+    {
+        const note_t& note = score[i];
+        int key = pitch::midi_note(note.octave, note.note);
+        if ((key < 0) || (key > 127))
+            continue;
+        uint32_t on = (uint32_t) std::lround(note.start * ticks_per_whole);
+        int64_t end = std::lround((note.start + note.duration) * ticks_per_whole);
+        uint32_t off = (uint32_t) std::max<int64_t>(end, on + 1);                            // a note under a tick still gets one, its off must not come first
+        int channel = 0;
+        while ((channel < 16) && ((channel == midi::PERCUSSION_CHANNEL) || (busy[channel * 128 + key] > on)))
+            ++channel;
+        if (channel == 16)
+            channel = 0;                                                                     // 15 notes on one key, let them cut each other
+        busy[channel * 128 + key] = std::max(busy[channel * 128 + key], off);
+        events.push_back(midi::event_t { on, (uint8_t) channel, (uint8_t) key, std::max<uint8_t>(note.velocity, 1) });
+        events.push_back(midi::event_t { off, (uint8_t) channel, (uint8_t) key, 0 });
+    }
+    /* at the same tick the note-offs go first, so a repeated key is not cut by its own predecessor */
+    std::stable_sort(events.begin(), events.end(), [](const midi::event_t& a, const midi::event_t& b)
+        { return (a.tick < b.tick) || ((a.tick == b.tick) && (a.velocity == 0) && (b.velocity != 0)); });
+
+    std::vector<uint8_t> track;
+    track.reserve(32 + text.size() + 4 * events.size());
+
+    if (!text.empty())
+    {
+        track.push_back(0);
+        track.push_back(0xFF);
+        track.push_back(0x01);
+        midi::put_vlq(track, (uint32_t) text.size());
+        track.insert(track.end(), text.begin(), text.end());
+    }
+    track.push_back(0);
+    track.push_back(0xFF);
+    track.push_back(0x51);
+    track.push_back(3);
+    midi::put_be(track, (uint32_t) std::lround(whole_note * 1e6 / 4), 3);                   // microseconds per quarter note
+
+    uint32_t tick = 0;
+    int status = -1;
+    for (size_t i = 0; i < events.size(); ++i)
+    {
+        midi::put_vlq(track, events[i].tick - tick);
+        if (status != 0x90 + events[i].channel)
+        {
+            status = 0x90 + events[i].channel;
+            track.push_back((uint8_t) status);                                               // running status until the channel changes
+        }
+        track.push_back(events[i].key);
+        track.push_back(events[i].velocity);
+        tick = events[i].tick;
+    }
+    track.push_back(0);
+    track.push_back(0xFF);
+    track.push_back(0x2F);
+    track.push_back(0);
+
+    std::vector<uint8_t> file;
+    file.reserve(22 + track.size());
+    file.insert(file.end(), { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1 });
+    midi::put_be(file, midi::EXPORT_DIVISION, 2);
+    file.insert(file.end(), { 'M', 'T', 'r', 'k' });
+    midi::put_be(file, (uint32_t) track.size(), 4);
+    file.insert(file.end(), track.begin(), track.end());
+
+    FILE* f = std::fopen(path.c_str(), "wb");
+    bool ok = (f != 0) && (std::fwrite(file.data(), 1, file.size(), f) == file.size());
+    if (f)
+        ok &= (std::fclose(f) == 0);
+    if (!ok)
+        fprintf(stderr, "failed to write %s\n", path.c_str());
+    return ok;
+}
+
+#endif /* __midi_file_included_2293847561029384756102938475610293847561029384756102 */
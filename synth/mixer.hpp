@@ -0,0 +1,333 @@
+#ifndef __mixer_included_2209384756102938475610293847561029384756102938475610
+#define __mixer_included_2209384756102938475610293847561029384756102938475610
+
+//=======================================================================================================================================================================================================================
+// polyphonic score renderer :: notes start at arbitrary times and may overlap, every note is shaped by the ADSR
+// envelope of the instrument and its release tail sounds past its nominal end, all active voices are summed into a float mix block and the
+// block is handed to the sink in one piece -- the sink does the conversion and the clipping
+// samples are normalized to [-1, 1]
+// every voice is a complex phasor z advanced by one multiply per sample, the harmonics are the powers z^2 .. z^4,
+// the per-sample rotations come from the pitch table and are derived once for the sample rate, not per note
+// render_block() neither allocates nor locks :: begin() reserves the voices for the peak polyphony of the score, so
+// the block loop can run on a real-time audio thread
+// live play :: begin_live() starts an endless stream without a score, note_on / note_off between two render_block()
+// calls start and release voices at a sample offset within the next block, at most MAX_LIVE_VOICES sound at once
+//=======================================================================================================================================================================================================================
+
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "envelope.hpp"
+#include "instrument.hpp"
+#include "pitch.hpp"
+#include "score.hpp"
+
+struct voice_t
+{
+    const instrument_t* instrument;
+    const envelope_params_t* envelope_params;
+    envelope_t envelope;
+    float re, im;                               /* phasor of the fundamental, cos and sin of the phase */
+    float wr, wi;                               /* rotation per sample */
+    float gain;
+    int delay;                                  /* samples to skip in the current block before the note onset */
+    int position;                               /* samples since the note onset */
+    int length;                                 /* nominal note duration in samples, note_off happens here, INT_MAX while a live key is held */
+    int midi;                                   /* MIDI note number */
+
+    bool finished() const
+        { return (position >= length) && envelope.finished(); }
+};
+
+struct mixer_t
+{
+    static const int BLOCK_SIZE = 1024;
+    static const int MAX_CHANNELS = 8;
+    static const int MAX_LIVE_VOICES = 64;
+
+    int sample_rate;
+    int channels = 1;                           /* the mono mix is copied to every output channel */
+    float whole_note;                           /* duration of a whole note in seconds */
+    float gain = 0.75f;                         /* master gain, leaves headroom for the overlapping release tails */
+    const pitch::pitch_table_t* pitch = &pitch::table();
+
+    float rotation[128][2];                     /* cos and sin of the phase increment of every MIDI note */
+    const pitch::pitch_table_t* rotation_pitch = 0;
+    int rotation_rate = 0;
+    float harmonic_c[instrument_t::HARMONICS];  /* amplitude * cos(phase) of the harmonics of the current instrument */
+    float harmonic_s[instrument_t::HARMONICS];  /* amplitude * sin(phase) */
+
+    const score_t* score = 0;                   /* the score being rendered and the position in it */
+    const instrument_t* instrument = 0;
+    envelope_params_t envelope_params;
+    size_t next = 0;                            /* the first note not started yet */
+    int64_t t = 0;                              /* samples rendered */
+    int64_t total = 0;                          /* samples in the score, including the release tails */
+    uint64_t dropped = 0;                       /* live notes not played because all the voices were busy */
+
+    std::vector<voice_t> voices;
+    float mix[BLOCK_SIZE];
+    float env[BLOCK_SIZE];
+    float frames[BLOCK_SIZE * MAX_CHANNELS];
+
+    mixer_t(int sample_rate, float whole_note = 2.0f)
+        : sample_rate(sample_rate), whole_note(whole_note)
+    {
+        voices.reserve(64);
+    }
+
+    /* selects the temperament and the reference pitch, takes effect with the next render */
+    void tune(pitch::temperament_t temperament, pitch::reference_t reference)
+        { pitch = &pitch::table(temperament, reference); }
+
+    /* phase increments of the table at the current sample rate, recomputed only when either of them changed */
+    void update_rotations()
+    {
+        if ((rotation_pitch == pitch) && (rotation_rate == sample_rate))
+            return;
+        for (int midi = 0; midi < 128; ++midi)
+        {
+            double w = 2 * M_PI * (*pitch)[midi] / sample_rate;
+            rotation[midi][0] = (float) std::cos(w);
+            rotation[midi][1] = (float) std::sin(w);
+        }
+        rotation_pitch = pitch;
+        rotation_rate = sample_rate;
+    }
+
+    void start_phasor(voice_t& v, int midi) const
+    {
+        if ((midi >= 0) && (midi < 128))
+        {
+            v.wr = rotation[midi][0];
+            v.wi = rotation[midi][1];
+        }
+        else
+        {
+            double w = 2 * M_PI * pitch::frequency(*pitch, midi) / sample_rate;
+            v.wr = (float) std::cos(w);
+            v.wi = (float) std::sin(w);
+        }
+        v.re = 1.0f;
+        v.im = 0.0f;
+    }
+
+    void start_voice(voice_t& v, int midi, int velocity, int delay, int length)
+    {
+        v.instrument = instrument;
+        v.envelope_params = &envelope_params;
+        v.envelope.note_on(envelope_params);
+        start_phasor(v, midi);
+        v.gain = gain * velocity / 127.0f;
+        v.delay = delay;
+        v.position = 0;
+        v.length = length;
+        v.midi = midi;
+    }
+
+    int64_t samples(float time) const
+        { return (int64_t) (time * whole_note * sample_rate); }
+
+    /* total length of the rendered score in samples, including the release tails */
+    int64_t length(const score_t& score, const envelope_params_t& envelope_params) const
+    {
+        int64_t end = 0;
+        for (const note_t& note : score)
+            end = std::max(end, samples(note.start + note.duration));
+        return score.empty() ? 0 : end + envelope_params.release_samples;
+    }
+
+    int64_t length(const score_t& score, const instrument_t& instrument) const
+        { return length(score, envelope_params_t(instrument.envelope, sample_rate)); }
+
+    /* the most voices alive at once, a finished voice is only dropped at the end of its block, hence the extra block */
+    size_t polyphony(const score_t& score, const envelope_params_t& envelope_params) const
+    {
+        std::vector<std::pair<int64_t, int>> events;
+        events.reserve(2 * score.size());
+        for (const note_t& note : score)
+        {
+            events.emplace_back(samples(note.start), 1);
+            events.emplace_back(samples(note.start + note.duration) + envelope_params.release_samples + BLOCK_SIZE, -1);
+        }
+        std::sort(events.begin(), events.end());
+
+        int voices = 0, peak = 0;
+        for (const auto& e : events)
+            peak = std::max(peak, voices += e.second);
+        return (size_t) peak;
+    }
+
+    /* adds the next n samples of the voice to out, the note is released at its nominal end */
+    void render_voice(voice_t& v, float* out, int n)
+    {
+        const float scale = v.gain / 32768.0f;
+
+        if (v.delay >= n)
+        {
+            v.delay -= n;
+            return;
+        }
+
+        int begin = v.delay;
+        int count = n - begin;
+        v.delay = 0;
+
+        if ((v.envelope.stage < envelope_t::RELEASE) && (v.position + count >= v.length))
+        {
+            int k = std::max(0, v.length - v.position);
+            v.envelope.render(env, k, *v.envelope_params);
+            v.envelope.note_off(*v.envelope_params);
+            v.envelope.render(env + k, count - k, *v.envelope_params);
+        }
+        else
+            v.envelope.render(env, count, *v.envelope_params);
+
+        /* sin(h x + p) = Im(z^h) cos p + Re(z^h) sin p */
+        const float* c = harmonic_c;
+        const float* s = harmonic_s;
+        float re = v.re, im = v.im;
+        for (int k = 0; k < count; k++)
+        {
+            float re2 = re * re - im * im, im2 = 2 * re * im;
+            float re3 = re2 * re - im2 * im, im3 = re2 * im + im2 * re;
+            float re4 = re2 * re2 - im2 * im2, im4 = 2 * re2 * im2;
+            float sample = (im * c[0] + re * s[0]) + (im2 * c[1] + re2 * s[1]) + (im3 * c[2] + re3 * s[2]) + (im4 * c[3] + re4 * s[3]);
+            out[begin + k] += sample * scale * env[k];
+
+            float t = re * v.wr - im * v.wi;
+            im = re * v.wi + im * v.wr;
+            re = t;
+        }
+
+        /* the rounding errors of the rotation grow the magnitude slowly, pull it back to 1 once per block */
+        float norm = 1.0f / std::sqrt(re * re + im * im);
+        v.re = re * norm;
+        v.im = im * norm;
+
+        v.position += count;
+    }
+
+    //===================================================================================================================================================================================================================
+    // pull-style rendering :: begin() prepares the score, every render_block() call renders the next block of at most
+    // max_frames interleaved frames and points block at it, 0 is returned once the score and its release tails are done
+    // the score and the instrument must stay alive until then
+    //===================================================================================================================================================================================================================
+    void begin(const score_t& score, const instrument_t& instrument)
+    {
+        prepare(instrument);
+        this->score = &score;
+        total = length(score, envelope_params);
+        voices.reserve(polyphony(score, envelope_params));
+    }
+
+    /* an endless stream of live notes, render_block() never returns 0 */
+    void begin_live(const instrument_t& instrument)
+    {
+        prepare(instrument);
+        score = 0;
+        total = INT64_MAX;
+        voices.reserve(MAX_LIVE_VOICES);
+    }
+
+    void prepare(const instrument_t& instrument)
+    {
+        this->instrument = &instrument;
+        envelope_params = envelope_params_t(instrument.envelope, sample_rate);
+        update_rotations();
+        for (int h = 0; h < instrument_t::HARMONICS; ++h)
+        {
+            harmonic_c[h] = instrument.amplitude[h] * std::cos(instrument.phase[h]);
+            harmonic_s[h] = instrument.amplitude[h] * std::sin(instrument.phase[h]);
+        }
+
+        t = 0;
+        next = 0;
+        dropped = 0;
+        voices.clear();
+    }
+
+    /* starts a live note offset samples into the next block, dropped if every reserved voice is busy */
+    void note_on(int midi, int velocity, int offset = 0)
+    {
+        if (voices.size() == voices.capacity())
+        {
+            ++dropped;
+            return;
+        }
+        voices.emplace_back();
+        start_voice(voices.back(), midi, velocity, offset, INT_MAX);
+    }
+
+    /* releases the held live voices of the note offset samples into the next block, -1 -- of every note */
+    void note_off(int midi, int offset = 0)
+    {
+        for (voice_t& v : voices)
+            if (((v.midi == midi) || (midi < 0)) && (v.length == INT_MAX))
+                v.length = v.position + std::max(0, offset - v.delay);
+    }
+
+    int render_block(float*& block, int max_frames = BLOCK_SIZE)
+    {
+        int n = (int) std::min<int64_t>(std::min(max_frames, (int) BLOCK_SIZE), total - t);
+        if (n <= 0)
+            return 0;
+        std::fill(mix, mix + n, 0.0f);
+
+        /* start the voices whose onset falls into this block */
+        while (score && (next < score->size()) && (samples((*score)[next].start) < t + n))
+        {
+            const note_t& note = (*score)[next++];
+            voice_t v;
+            start_voice(v, pitch::midi_note(note.octave, note.note), note.velocity, (int) std::max<int64_t>(0, samples(note.start) - t),
+                        (int) (samples(note.start + note.duration) - samples(note.start)));
+            voices.push_back(v);
+        }
+
+        for (size_t i = 0; i < voices.size(); )
+        {
+            voice_t& v = voices[i];
+            render_voice(v, mix, n);
+            if (v.finished())
+            {
+                v = voices.back();
+                voices.pop_back();
+            }
+            else
+                ++i;
+        }
+
+        t += n;
+        if (channels == 1)
+        {
+            block = mix;
+            return n;
+        }
+        for (int k = 0; k < n; ++k)
+            for (int c = 0; c < channels; ++c)
+                frames[k * channels + c] = mix[k];
+        block = frames;
+        return n;
+    }
+
+    //===================================================================================================================================================================================================================
+    // renders the score block by block, the sink must provide write(float* frames, int n) taking n interleaved frames
+    // and may modify the block
+    // returns the number of rendered samples
+    //===================================================================================================================================================================================================================
+    template<typename sink_t> int64_t render(const score_t& score, const instrument_t& instrument, sink_t& sink)
+    {
+        begin(score, instrument);
+        float* block;
+        int n;
+        while ((n = render_block(block)) > 0)
+            sink.write(block, n);
+        return total;
+    }
+};
+
+#endif /* __mixer_included_2209384756102938475610293847561029384756102938475610 */
@@ -0,0 +1,90 @@
+#ifndef __noise_included_5102836640918273645501928374650192837465019283746501
+#define __noise_included_5102836640918273645501928374650192837465019283746501
+
+//=======================================================================================================================================================================================================================
+// block noise generator : LANES independent xorshift32 streams advanced in lock-step
+// the lane loop has no cross-lane dependency and compiles to packed shifts/xors (SSE2/AVX2/NEON),
+// one call produces a whole block of noise, the sequence depends only on the seed
+//=======================================================================================================================================================================================================================
+
+#include <cstdint>
+
+struct noise_t
+{
+    static const int LANES = 8;
+
+    uint32_t state[LANES];
+
+    noise_t(uint32_t seed = 1)
+        { reset(seed); }
+
+    /* seeds the lanes with splitmix32 outputs of the seed, xorshift state must never be zero */
+    void reset(uint32_t seed)
+    {
+        for (int l = 0; l < LANES; ++l)
+        {
+            uint32_t z = (seed += 0x9E3779B9u);
+            z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+            z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+            z = z ^ (z >> 16);
+            state[l] = z ? z : 0x6D2B79F5u;
+        }
+    }
+
+    /* fills out[0 .. n) with uniformly distributed 32-bit words */
+    void uniform(uint32_t* out, int n)
+    {
+        uint32_t s[LANES];
+        for (int l = 0; l < LANES; ++l)
+            s[l] = state[l];
+
+        int i = 0;
+        for (; i + LANES <= n; i += LANES)
+        {
+            for (int l = 0; l < LANES; ++l)
+            {
+                uint32_t x = s[l];
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                s[l] = x;
+                out[i + l] = x;
+            }
+        }
+
+        for (int l = 0; i < n; ++i, ++l)
+        {
+            uint32_t x = s[l];
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            s[l] = x;
+            out[i] = x;
+        }
+
+        for (int l = 0; l < LANES; ++l)
+            state[l] = s[l];
+    }
+
+    /* adds triangular (TPDF) dither in [-amplitude, amplitude] to data[0 .. n),
+       the two uniform variables are the high and the low halves of one 32-bit word */
+    void add_triangular(float* data, int n, float amplitude)
+    {
+        const int CHUNK = 256;
+        uint32_t words[CHUNK];
+        const float scale = amplitude / 65535.0f;
+
+        for (int i = 0; i < n; i += CHUNK)
+        {
+            int m = (n - i < CHUNK) ? n - i : CHUNK;
+            uniform(words, m);
+            for (int k = 0; k < m; ++k)
+            {
+                int32_t u = (int32_t) (words[k] >> 16) + (int32_t) (words[k] & 0xFFFF) - 65535;
+                data[i + k] += scale * (float) u;
+            }
+        }
+    }
+};
+
+#endif /* __noise_included_5102836640918273645501928374650192837465019283746501 */
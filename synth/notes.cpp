@@ -4,30 +4,30 @@
 #include <string>
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
 #include <math.h>
-
-static const int one = 1;
-static bool isLE = (*(const uint8_t*)(&one));
-const int sampleRate = 8192;
-
-float frequency(int note, int o)
-{
-    return 16.351786f * pow(2.0f, o + note / 12.0f);
-}
-
-//=============================================================================================================================================================================
-//=============================================================================================================================================================================
-//=============================================================================================================================================================================
-
-struct note_t
-{
-    float duration;
-    int octave;
-    int note;
-
-    note_t(float duration, int octave, int note) :
-        duration(duration), octave(octave), note(note) {}
-};
+#include <sys/stat.h>
+
+#include "audio_buffer_writer.hpp"
+#include "bounded_queue.hpp"
+#include "chords.hpp"
+#include "instrument.hpp"
+#include "melody_hash.hpp"
+#include "midi_file.hpp"
+#include "mixer.hpp"
+#include "noise.hpp"
+#include "pitch.hpp"
+#include "score.hpp"
+#include "stream_writer.hpp"
 
 note_t moonlight_sonata[] =
 {
@@ -51,188 +51,10 @@ note_t moonlight_sonata[] =
 
 const int sonata_length = sizeof(moonlight_sonata) / sizeof(note_t);
 
-struct WAV_writer
-{
-    // I don't think it's at all my fault that some players
-    // claim to support WAV format, but fail to play a WAV
-    // file that has lower sample rate than "standard".
-
-    FILE* wavefile = 0;
-
-    bool create(const std::string& filename)
-    {
-        wavefile = std::fopen(filename.c_str(), "wb");
-        if (wavefile == 0)
-            return false;
-
-        if (isLE)
-            std::fprintf(wavefile, "RIFF");                         //ASCII for 0x52494646, the magic number that WAV files start with
-        else
-            std::fprintf(wavefile, "RIFX");                         //Big endian WAV file starts with magic number 0x52494658, or, in ASCII, "RIFX"
-
-        int32_t ChunkSize = 36 + 8 * sampleRate * 2;
-        std::fwrite(&ChunkSize, 4, 1, wavefile);
-        std::fprintf(wavefile, "WAVEfmt ");                         //The beginning of the header
-        int32_t Subchunk1Size = 16;                                 //PCM header is always 16 bytes
-        std::fwrite(&Subchunk1Size, 4, 1, wavefile);
-        int16_t AudioFormat = 1;                                    //PCM format
-        std::fwrite(&AudioFormat, 2, 1, wavefile);
-        int16_t NumChannels = 1;                                    //MONO audio
-        std::fwrite(&NumChannels, 2, 1, wavefile);
-        int32_t SampleRate = sampleRate;
-        std::fwrite(&SampleRate, 4, 1, wavefile);
-        int32_t ByteRate = 2 * sampleRate;                          //Since we are using 16 bits per sample and "sampleRate" samples per second
-        std::fwrite(&ByteRate, 4, 1, wavefile);
-        int16_t BlockAlign = 2;                                     //Each block is two bytes
-        std::fwrite(&BlockAlign, 2, 1, wavefile);
-        int16_t BitsPerSample = 16;
-        std::fwrite(&BitsPerSample, 2, 1, wavefile);
-        std::fprintf(wavefile, "data");
-
-        return true;
-    }
-
-    void fill_note(float duration, float frequency)
-    {
-        int noteDuration = sampleRate * duration * 2.0f;
-
-        for (int i = 0; i < noteDuration; i++)
-        {
-            float baseFrequency = std::sin(2 * M_PI * 1 * frequency * i / sampleRate) * std::pow(2, 14);
-            float secondHarmony = std::sin(2 * M_PI * 2 * frequency * i / sampleRate + M_PI / 4) * std::pow(2, 12);
-            float thirdHarmony  = std::sin(2 * M_PI * 3 * frequency * i / sampleRate + M_PI / 2) * std::pow(2, 10);
-            float fourthHarmony = std::sin(2 * M_PI * 4 * frequency * i / sampleRate - M_PI / 4) * std::pow(2, 9);
-            float currentAmplitude = (baseFrequency + secondHarmony + thirdHarmony + fourthHarmony) * std::exp(-(float)(1.25f * i) / (sampleRate)); // Attenuation.
-            int16_t numberToBeWritten = currentAmplitude + std::rand() % (1 << 8) - (1 << 7);                           /* A bit of noise makes it sound better */
-            std::fwrite(&numberToBeWritten, 2, 1, wavefile);
-        }
-    }
-
-    void finish()
-    {
-        std::fclose(wavefile);
-        wavefile = 0;
-    }
-
-    static void notes2file(const std::string& filename, note_t* notes, int size)
-    {
-        WAV_writer writer;
-        writer.create(filename);
-
-        for (int s = 0; s < size; ++s)
-        {
-            const note_t& note = notes[s];
-            writer.fill_note(
-                note.duration,
-                frequency(note.note, note.octave)
-            );
-        }
-
-        writer.finish();
-    }
-};
-
 //=============================================================================================================================================================================
 //=============================================================================================================================================================================
 //=============================================================================================================================================================================
 
-/* array mix :: starting_index = 0, amount = 48 */
-int nabornot[][6] = {
-    {0, 1, 3, 5, 6, 8 },
-    {0, 1, 3, 4, 6, 8 },
-    {0, 1, 3, 5, 6, 9 },
-    {0, 2, 3, 5, 6, 9 },
-    {0, 3, 4, 6, 8, 11 },
-    {0, 3, 4, 6, 7, 11 },
-    {0, 1, 3, 5, 6, 9 },
-    {0, 2, 3, 6, 7, 11 },
-    {0, 2, 3, 6, 7, 10 },
-    {0, 1, 3, 4, 6, 9 },
-    {0, 1, 3, 5, 6, 9 },
-    {0, 2, 3, 5, 6, 10 },
-    {0, 1, 3, 5, 6, 10 },
-    {0, 1, 3, 5, 7, 9 },
-    {0, 2, 3, 5, 7, 8 },
-    {0, 2, 3, 6, 7, 10 },
-    {0, 3, 5, 7, 8, 11 },
-    {0, 1, 3, 5, 7, 9 },
-    {0, 2, 3, 7, 8, 11 },
-    {0, 1, 3, 5, 7, 9 },
-    {0, 1, 3, 4, 7, 10 },
-    {0, 2, 3, 6, 7, 10 },
-    {0, 2, 3, 5, 7, 11 },
-    {0, 1, 4, 5, 7, 9 },
-    {0, 2, 4, 5, 7, 8 },
-    {0, 2, 4, 6, 7, 10 },
-    {0, 3, 4, 6, 7, 9 },
-    {0, 4, 5, 7, 8, 11 },
-    {0, 1, 4, 5, 7, 9 },
-    {0, 2, 4, 6, 7, 10 },
-    {0, 2, 4, 7, 8, 11 },
-    {0, 1, 4, 5, 7, 9 },
-    {0, 2, 4, 6, 7, 10 },
-    {0, 2, 4, 5, 7, 11 },
-    {0, 2, 4, 6, 8, 9 },
-    {0, 2, 4, 5, 8, 9 },
-    {0, 3, 4, 6, 8, 9 },
-    {0, 3, 4, 7, 8, 10 },
-    {0, 3, 4, 6, 8, 10 },
-    {0, 1, 4, 6, 8, 10 },
-    {0, 1, 4, 6, 8, 9 },
-    {0, 1, 4, 7, 8, 10 },
-    {0, 2, 4, 7, 8, 10 },
-    {0, 2, 4, 5, 8, 10 },
-    {0, 1, 4, 5, 8, 10 },
-    {0, 2, 4, 5, 8, 11 },
-    {0, 3, 4, 6, 8, 11 },
-    {0, 2, 4, 6, 8, 11 },
-                                        /* array minmin :: starting_index = 48, amount = 8 */
-    {0, 2, 3, 5, 6, 11 },
-    {0, 1, 3, 4, 6, 10 },
-    {0, 2, 3, 6, 8, 11 },
-    {0, 1, 3, 6, 7, 10 },
-    {0, 3, 5, 6, 8, 11 },
-    {0, 3, 4, 6, 7, 10 },
-    {0, 2, 3, 5, 6, 8 },
-    {0, 1, 3, 4, 6, 7 },
-                                                    /* array majmaj :: starting_index = 56, amount = 9 */
-    {0, 3, 4, 7, 8, 11 },
-    {0, 2, 4, 6, 8, 10 },
-    {0, 1, 4, 5, 8, 9 },
-    {0, 3, 4, 7, 8, 11 },
-    {0, 2, 4, 6, 8, 10 },
-    {0, 1, 4, 5, 8, 9 },
-    {0, 3, 4, 7, 8, 11 },
-    {0, 2, 4, 6, 8, 10 },
-    {0, 1, 4, 5, 8, 9 },
-                                                            /* array durmol :: starting_index = 65, amount = 12 */
-    {0, 2, 4, 6, 7, 11 },
-    {0, 1, 4, 5, 7, 10 },
-    {0, 3, 4, 7, 8, 11 },
-    {0, 1, 4, 6, 7, 9 },
-    {0, 3, 4, 6, 7, 10 },
-    {0, 2, 4, 5, 7, 9 },
-    {0, 2, 3, 6, 7, 9 },
-    {0, 1, 3, 5, 7, 8 },
-    {0, 1, 3, 6, 7, 10 },
-    {0, 1, 3, 4, 7, 9 },
-    {0, 2, 3, 5, 7, 10 },
-    {0, 3, 4, 7, 8, 11 },
-                                                        /* array durdur :: starting_index = 77, amount = 5 */
-    {0, 1, 4, 5, 7, 8 },
-    {0, 3, 4, 6, 7, 11 },
-    {0, 2, 4, 5, 7, 10 },
-    {0, 1, 4, 6, 7, 10 },
-    {0, 2, 4, 6, 7, 9 },
-                                                        /* array molmol :: starting_index = 82, amount = 5 */
-    {0, 1, 3, 4, 7, 8 },
-    {0, 2, 3, 5, 7, 9 },
-    {0, 1, 3, 6, 7, 9 },
-    {0, 1, 3, 5, 7, 10 },
-    {0, 2, 3, 6, 7, 11 },
-};
-
-const int KOLICHESTVO_NABOROFF_NOT = sizeof(nabornot) / sizeof(int[6]);
 /*
 void process_array(int* array, int N, std::string array_name)
 {
@@ -267,29 +89,134 @@ double dliniinot[11] = {1, 0.75, 0.5, 0.375, 0.25, 0.1875, 0.125, 0.09375, 0.062
 //=============================================================================================================================================================================
 
 
-std::random_device rd;                                                              //Wimajmaj be used to obtain a seed for the random number engine
-std::mt19937 gen(rd());                                                             //Standard mersenne_twister_engine seeded with rd()
-
-
-int min_index[] = { 0, 48, 56, 65, 77, 82};
-int max_index[] = {47, 55, 64, 76, 81, 86};
+//=============================================================================================================================================================================
+// every melody gets its own generator seeded from (seed, melody index), so the output does
+// not depend on the number of worker threads or on the order in which the melodies are rendered
+//=============================================================================================================================================================================
+std::mt19937 melody_generator(uint32_t seed, int index)
+{
+    std::seed_seq sequence = { seed, (uint32_t) index };
+    return std::mt19937(sequence);
+}
 
-int random(int a, int b)
+int random(std::mt19937& gen, int a, int b)
 {
     std::uniform_int_distribution<> distrib(a, b);
     return distrib(gen);
 }
 
-int random_2(int a)
+//=============================================================================================================================================================================
+// melodic step :: |sum of w independent draws from {-1, 0, 1}| for w = 0 .. MAX_STEP_DRAWS
+// the probability of a step k is the folded trinomial coefficient over 3^w, an integer count, so a Walker alias table
+// with n = w + 1 columns of capacity 3^w represents the distribution exactly and is sampled with one uniform draw
+// the tables are built at compile time and checked to reproduce the counts
+//=============================================================================================================================================================================
+static const int MAX_STEP_DRAWS = 17;
+
+struct step_table_t
 {
-    int u = 0;
-    for (int c = 0; c < a; ++c)
+    uint32_t total;                                                                     // 3^w, the capacity of a column
+    int n;                                                                              // w + 1 possible steps
+    uint32_t count[MAX_STEP_DRAWS + 1];                                                 // 3^w * P(step = k)
+    uint32_t threshold[MAX_STEP_DRAWS + 1];
+    uint8_t alias[MAX_STEP_DRAWS + 1];
+
+    constexpr step_table_t(int w)
+        : total(1), n(w + 1), count(), threshold(), alias()
+    {
+        /* coefficients of (1 + x + x^2)^w, the sum of w draws is k - w for the coefficient of x^k */
+        uint64_t c[2 * MAX_STEP_DRAWS + 1] = {};
+        c[0] = 1;
+        for (int i = 0; i < w; ++i)
+        {
+            for (int k = 2 * i + 2; k >= 0; --k)
+                c[k] = c[k] + (k >= 1 ? c[k - 1] : 0) + (k >= 2 ? c[k - 2] : 0);
+            total *= 3;
+        }
+        for (int k = 0; k <= w; ++k)
+            count[k] = (uint32_t) ((k == 0) ? c[w] : c[w + k] + c[w - k]);
+
+        /* Vose's construction on the counts scaled by n, all in integers */
+        uint64_t q[MAX_STEP_DRAWS + 1] = {};
+        int small[MAX_STEP_DRAWS + 1] = {}, large[MAX_STEP_DRAWS + 1] = {};
+        int ns = 0, nl = 0;
+        for (int k = 0; k < n; ++k)
+        {
+            q[k] = (uint64_t) count[k] * n;
+            if (q[k] < total)
+                small[ns++] = k;
+            else
+                large[nl++] = k;
+        }
+        while ((ns > 0) && (nl > 0))
+        {
+            int s = small[--ns], l = large[--nl];
+            threshold[s] = (uint32_t) q[s];
+            alias[s] = (uint8_t) l;
+            q[l] -= total - q[s];
+            if (q[l] < total)
+                small[ns++] = l;
+            else
+                large[nl++] = l;
+        }
+        while (nl > 0)
+        {
+            int l = large[--nl];
+            threshold[l] = total;
+            alias[l] = (uint8_t) l;
+        }
+        while (ns > 0)
+        {
+            int s = small[--ns];
+            threshold[s] = total;
+            alias[s] = (uint8_t) s;
+        }
+    }
+
+    /* the mass every step receives from the columns, must equal count * n */
+    constexpr bool exact() const
     {
-        u = u + random(-1, 1);
+        uint64_t mass[MAX_STEP_DRAWS + 1] = {};
+        uint64_t sum = 0;
+        for (int k = 0; k < n; ++k)
+        {
+            mass[k] += threshold[k];
+            mass[alias[k]] += total - threshold[k];
+            sum += count[k];
+        }
+        for (int k = 0; k < n; ++k)
+            if (mass[k] != (uint64_t) count[k] * n)
+                return false;
+        return sum == total;
     }
-    if (u < 0)
-        u = -u;
-    return u;
+};
+
+static constexpr step_table_t step_tables[MAX_STEP_DRAWS + 1] =
+{
+    step_table_t(0),  step_table_t(1),  step_table_t(2),  step_table_t(3),  step_table_t(4),  step_table_t(5),
+    step_table_t(6),  step_table_t(7),  step_table_t(8),  step_table_t(9),  step_table_t(10), step_table_t(11),
+    step_table_t(12), step_table_t(13), step_table_t(14), step_table_t(15), step_table_t(16), step_table_t(17),
+};
+
+constexpr bool step_tables_exact()
+{
+    for (int w = 0; w <= MAX_STEP_DRAWS; ++w)
+        if (!step_tables[w].exact())
+            return false;
+    return true;
+}
+
+static_assert(step_tables_exact(), "the alias tables must reproduce the step distribution exactly");
+static_assert(step_tables[2].count[0] == 3 && step_tables[2].count[1] == 4 && step_tables[2].count[2] == 2, "(1 + x + x^2)^2 = 1 2 3 2 1");
+static_assert((uint64_t) (MAX_STEP_DRAWS + 1) * step_tables[MAX_STEP_DRAWS].total <= 0xFFFFFFFFull, "a column and its offset must fit one 32-bit draw");
+
+/* same distribution as summing w calls of random(gen, -1, 1) and taking the absolute value, with one draw */
+int random_step(std::mt19937& gen, int w)
+{
+    const step_table_t& t = step_tables[w];
+    uint32_t x = std::uniform_int_distribution<uint32_t>(0, t.n * t.total - 1)(gen);
+    uint32_t column = x / t.total;
+    return (x % t.total < t.threshold[column]) ? (int) column : t.alias[column];
 }
 
 /* void print_note(int k)
@@ -314,21 +241,591 @@ int random_2(int a)
 //=============================================================================================================================================================================
 //=============================================================================================================================================================================
 
-int main()
+struct melody_params_t
 {
+    /* the melody spans three octaves from the given one, these keep every note inside the MIDI range 0 .. 127 */
+    static const int MIN_OCTAVE = 0;
+    static const int MAX_OCTAVE = 7;
+
+    int chords = 6;                                                                     // chord class, 1 .. 6
+    int bars = 4;
+    float durations[11];                                                                // allowed note durations
+    int durations_count = 0;
+    int octave = 4;
+    int count = 1;
+    int syncopes = 2;                                                                   // 1 -- no syncopes, 2 -- syncopes
+    std::vector<int> instruments = { 1 };                                               // every melody is rendered with each of them
+    int sample_rate = 8192;
+    int channels = 1;
+    int bit_depth = 16;                                                                 // 16, 24 or 32 (float)
+    AudioFileFormat format = AudioFileFormat::Wave;                                     // Wave or Aiff
+    pitch::temperament_t temperament = pitch::EQUAL;
+    pitch::reference_t reference = pitch::A440;                                         // pitch of A4
+    bool harmony = false;                                                               // accompany every bar with the chord set
+    std::string output_dir = ".";
+    std::string stream;                                                                 // "-" -- stdout, or a FIFO, empty -- one file per melody
+    bool raw = false;                                                                   // stream headerless PCM instead of WAV
+    std::string midi_file;                                                              // render this score instead of generated melodies
+    bool save_midi = false;                                                             // also write every melody as outputN.mid
+    bool audio = true;                                                                  // false -- only the MIDI files, render the chosen ones later
+    bool unique = false;                                                                // skip melodies that were already generated
+    float similarity = 0.0f;                                                            // also skip near duplicates at this n-gram similarity, 0 -- off
+    bool verbose = true;                                                                // print the note log of every melody
+};
 
-//    process_array(&mix[0][0],    48, "mix");
-//    process_array(&minmin[0][0], 8,  "minmin");
-//    process_array(&majmaj[0][0], 9,  "majmaj");
-//    process_array(&durmol[0][0], 12, "durmol");
-//    process_array(&durdur[0][0], 5,  "durdur");
-//    process_array(&molmol[0][0], 5,  "molmol");
-//    return 0;
-//
-//    WAV_writer::notes2file("bethoveen.wav", moonlight_sonata, sonata_length);
+/* the text output goes to stderr when stdout carries the audio */
+FILE* console(const melody_params_t& params)
+{
+    return (params.stream == "-") ? stderr : stdout;
+}
 
-start:
-    int x, y, t;
+struct batch_stats_t
+{
+    int melodies = 0;
+    int duplicates = 0;
+    int64_t notes = 0;
+    int64_t samples = 0;
+    int64_t bytes = 0;
+};
+
+//=============================================================================================================================================================================
+// shortest and longest note in 1/32 units, unsupported values fall back to the defaults of 4 and 8
+//=============================================================================================================================================================================
+bool valid_duration(float v)
+{
+    return (v == 1) || (v == 1.5) || (v == 2) || (v == 3) || (v == 4) || (v == 6) || (v == 8) || (v == 12) || (v == 16) || (v == 24) || (v == 32);
+}
+
+void set_durations(melody_params_t& params, float sk, float sd)
+{
+    if (!valid_duration(sk)) sk = 4;
+    if (!valid_duration(sd)) sd = 8;
+    if (sk > sd) sd = 8;
+
+    int q = 0;
+    for (int a = 0; a < 11; ++a)
+    {
+        if ((dliniinot[a] <= (sd / 32.0f)) && (dliniinot[a] >= (sk / 32.0f)))
+        {
+            params.durations[q] = dliniinot[a];
+            ++q;
+        }
+    }
+    params.durations_count = q;
+}
+
+//=============================================================================================================================================================================
+// pipeline stage 1 :: random walk over the chord set, produces the note list of melody #index
+//=============================================================================================================================================================================
+struct melody_t
+{
+    int index;
+    uint32_t noise_seed;
+    score_t notes;
+    std::string name;                                                                   // output file name, empty -- outputN
+};
+
+void generate_melody(const melody_params_t& params, uint32_t seed, int y, melody_t& melody, std::string& log, melody_hash_t* fingerprint = 0)
+{
+    std::mt19937 gen = melody_generator(seed, y);
+    melody.index = y;
+    melody.noise_seed = gen();
+    melody.notes.clear();
+    char line[64];
+
+    int x = params.chords;
+    int q = params.durations_count;
+    (void) random(gen, 0, 11);                                                              // no longer used, still drawn so that the later draws keep their order
+    int r = random(gen, chords::table.min_index(x), chords::table.max_index(x));            //nomer nabora not
+    float d = 0.0f;
+    int e = random(gen, 6, 11);
+
+    if (params.verbose)
+        log = "vasha melodia #" + std::to_string(y + 1) + ":\n";
+    if (fingerprint)
+        fingerprint->reset();
+
+    while (params.bars > d)
+    {
+        int c = 0;
+        if (params.syncopes == 1)
+        {
+            while ((c < q - 1) && (params.durations[c] > (1 - d + floor(d))))
+            {
+                ++c;
+            }
+        }
+        float h = params.durations[random(gen, c, q - 1)];
+        int o = params.octave + floor(e / 6);
+        int n = e % 6;
+        melody.notes.push_back(note_t(d, h, o, chords::table.sets[r][n]));
+        if (fingerprint)
+            fingerprint->add(melody.notes.back());
+        if (params.verbose)
+        {
+            std::snprintf(line, sizeof(line), "{%f, %d, %d} :: %.5f \n", h, o, n, frequency(chords::table.sets[r][n], o));   //kodovaja zapis'
+            log += line;
+        }
+        int w = std::max(17 - e, e);
+        int l = random_step(gen, w);
+        e = e + (2 * random(gen, 0, 1) - 1) * l;
+        if (e < 0)
+            e = e + 2 * l;
+        if (e > 17)
+            e = e - 2 * l;
+        d = d + h;
+    }
+
+    /* every bar is accompanied by the whole chord set, sounding quietly one octave below the melody */
+    if (params.harmony)
+    {
+        for (int bar = 0; bar < params.bars; ++bar)
+            for (int k = 0; k < 6; ++k)
+                melody.notes.push_back(note_t(bar, 1.0f, params.octave, chords::table.sets[r][k], 24));
+        std::stable_sort(melody.notes.begin(), melody.notes.end(), [](const note_t& a, const note_t& b) { return a.start < b.start; });
+    }
+}
+
+//=============================================================================================================================================================================
+// pipeline stage 2 :: renders the note list with every requested instrument into output_dir/outputN.wav (.aif),
+// or into output_dir/outputN_I.wav when more than one instrument is requested
+// the audio buffer is sized from the computed length and saved by AudioFile, the caller keeps it between melodies
+//=============================================================================================================================================================================
+void render_melody(const melody_params_t& params, const melody_t& melody, mixer_t& mixer, AudioFile<float>& audio, audio_buffer_writer_t& writer, batch_stats_t& stats)
+{
+    for (size_t k = 0; k < params.instruments.size(); ++k)
+    {
+        int instrument = params.instruments[k];
+        std::string filename = params.output_dir + "/" + (melody.name.empty() ? "output" + std::to_string(melody.index) : melody.name);
+        if (params.instruments.size() > 1)
+            filename += "_" + std::to_string(instrument);
+        filename += (params.format == AudioFileFormat::Aiff) ? ".aif" : ".wav";
+
+        writer.begin(audio, params.sample_rate, params.channels, params.bit_depth, mixer.length(melody.notes, instruments[instrument - 1]));
+        writer.noise.reset(melody.noise_seed);
+        mixer.render(melody.notes, instruments[instrument - 1], writer);
+        if (!audio.save(filename, params.format))
+            fprintf(stderr, "failed to write %s\n", filename.c_str());
+        stats.samples += writer.position;
+        stats.bytes += writer.bytes();
+    }
+}
+
+/* writes the melody as output_dir/outputN.mid, the text event records how to generate it again */
+void save_melody(const melody_params_t& params, uint32_t seed, const melody_t& melody)
+{
+    char text[256];
+    std::snprintf(text, sizeof(text), "notes --seed %u --chords %d --bars %d --shortest %g --longest %g --octave %d --syncopes %d%s :: melody #%d",
+                  seed, params.chords, params.bars, params.durations[params.durations_count - 1] * 32, params.durations[0] * 32,
+                  params.octave + 1, params.syncopes - 1, params.harmony ? " --harmony" : "", melody.index + 1);
+    std::string name = melody.name.empty() ? "output" + std::to_string(melody.index) : melody.name;
+    save_midi(params.output_dir + "/" + name + ".mid", melody.notes, params.midi_file.empty() ? text : "");
+}
+
+/* appends the melody to the stream, once per instrument */
+void stream_melody(const melody_params_t& params, const melody_t& melody, mixer_t& mixer, stream_writer_t& stream, batch_stats_t& stats)
+{
+    for (size_t k = 0; (k < params.instruments.size()) && stream.ok; ++k)
+    {
+        int64_t start = stream.samples_written;
+        stream.noise.reset(melody.noise_seed);
+        mixer.render(melody.notes, instruments[params.instruments[k] - 1], stream);
+        stats.samples += stream.samples_written - start;
+        stats.bytes += (stream.samples_written - start) * stream.bytes_per_frame();
+    }
+}
+
+//=============================================================================================================================================================================
+// generates params.count melodies on one thread and renders them on the given number of threads (0 -- all available cores),
+// the stages are connected by a bounded queue, so the generator never waits for the file output unless the renderers are full
+// a stream must receive the melodies in order, so it is fed by a single renderer
+//=============================================================================================================================================================================
+batch_stats_t render_melodies(const melody_params_t& params, uint32_t seed, int threads = 0)
+{
+    if (threads <= 0)
+        threads = std::thread::hardware_concurrency();
+    threads = std::max(1, std::min(threads, params.count));
+
+    stream_writer_t stream;
+    if (!params.stream.empty())
+    {
+        if (!stream.open(params.stream, params.raw ? stream_writer_t::RAW : stream_writer_t::WAV, params.sample_rate, params.channels, params.bit_depth))
+        {
+            fprintf(stderr, "failed to open %s\n", params.stream.c_str());
+            return batch_stats_t();
+        }
+        threads = 1;
+    }
+
+    bounded_queue_t<melody_t> queue(4 * threads);
+    std::mutex stats_mutex;
+    batch_stats_t total;
+    int duplicates = 0;
+
+    std::thread generator([&]()
+    {
+        std::string log;
+        melody_hash_t fingerprint;
+        melody_filter_t filter;
+        bool dedup = params.unique || (params.similarity > 0.0f);
+        fingerprint.minhash = (params.similarity > 0.0f);
+        filter.set_threshold(params.similarity);
+
+        if (!params.midi_file.empty())
+        {
+            melody_t melody;
+            melody.index = 0;
+            melody.noise_seed = seed;
+            melody.name = params.midi_file.substr(params.midi_file.find_last_of('/') + 1);
+            melody.name = melody.name.substr(0, melody.name.find_last_of('.'));
+            if (load_midi(params.midi_file, melody.notes))
+                queue.push(std::move(melody));
+            queue.close();
+            return;
+        }
+
+        for (int y = 0; (y < params.count) && stream.ok; ++y)
+        {
+            melody_t melody;
+            generate_melody(params, seed, y, melody, log, dedup ? &fingerprint : 0);
+            bool accepted = !dedup || filter.accept(fingerprint);
+            if (params.verbose)
+            {
+                std::fputs(log.c_str(), console(params));
+                if (!accepted)
+                    std::fputs("(duplicate, skipped)\n", console(params));
+            }
+            if (accepted)
+                queue.push(std::move(melody));
+            else
+                ++duplicates;
+        }
+        queue.close();
+    });
+
+    auto worker = [&]()
+    {
+        AudioFile<float> audio;
+        audio_buffer_writer_t writer;
+        mixer_t mixer(params.sample_rate);
+        mixer.channels = params.channels;
+        mixer.tune(params.temperament, params.reference);
+        batch_stats_t stats;
+        melody_t melody;
+        while (queue.pop(melody))
+        {
+            if (stream.is_open() && !stream.ok)
+                continue;                                                               // the reader went away, drain the queue so the generator can finish
+            if (params.save_midi)
+                save_melody(params, seed, melody);
+            if (params.audio && stream.is_open())
+                stream_melody(params, melody, mixer, stream, stats);
+            else if (params.audio)
+                render_melody(params, melody, mixer, audio, writer, stats);
+            ++stats.melodies;
+            stats.notes += melody.notes.size();
+        }
+
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        total.melodies += stats.melodies;
+        total.notes += stats.notes;
+        total.samples += stats.samples;
+        total.bytes += stats.bytes;
+    };
+
+    std::vector<std::thread> workers;
+    for (int k = 1; k < threads; ++k)
+        workers.emplace_back(worker);
+    worker();
+    for (std::thread& w : workers)
+        w.join();
+    generator.join();
+    total.duplicates = duplicates;
+
+    if (stream.is_open() && !stream.close())
+        fprintf(stderr, "failed to write %s\n", params.stream.c_str());
+    return total;
+}
+
+//=============================================================================================================================================================================
+// batch mode :: all the parameters come from the command line or from a job file with one job per line,
+// written with the same flags, empty lines and lines starting with # are skipped
+//=============================================================================================================================================================================
+void print_usage(const char* program)
+{
+    printf("usage: %s [flags]\n"
+           "  --chords N       chord class: 1 mix, 2 minmin, 3 majmaj, 4 durmol, 5 durdur, 6 molmol (default 6)\n"
+           "  --bars N         number of bars (default 4)\n"
+           "  --shortest X     shortest note in 1/32 units: 1, 1.5, 2, 3, 4, 6, 8, 12, 16, 24, 32 (default 4)\n"
+           "  --longest X      longest note in 1/32 units (default 8)\n"
+           "  --octave N       approximate octave of the melody, 0 .. 7 (default 5)\n"
+           "  --count N        number of melodies (default 1)\n"
+           "  --syncopes 0|1   allow notes to cross the bar line (default 1)\n"
+           "  --instrument N   instrument, 1 .. 6, or a comma separated list of instruments (default 1)\n"
+           "  --seed N         base seed of the melody generators (default: random)\n"
+           "  --rate N         sample rate in Hz (default 8192)\n"
+           "  --channels N     number of output channels, the mono mix is copied to all of them (default 1)\n"
+           "  --bits N         16 or 24 for integer PCM, 32 for float (default 16)\n"
+           "  --format F       wav or aiff, 32-bit AIFF samples are integers (default wav)\n"
+           "  --temperament T  equal, pythagorean, just, meantone or werckmeister (default equal)\n"
+           "  --reference HZ   pitch of A4: 440, 442, 432 or 415 (default 440)\n"
+           "  --output DIR     output directory (default .)\n"
+           "  --stream PATH    write all the melodies as one WAV stream to PATH (a FIFO, or - for stdout) instead of files\n"
+           "  --raw            stream headerless little-endian PCM instead of WAV\n"
+           "  --threads N      number of worker threads (default: all cores)\n"
+           "  --harmony        accompany every bar with the chord set of the melody\n"
+           "  --unique         skip melodies identical to one generated before, the others keep their numbers\n"
+           "  --similarity X   also skip melodies whose note 3-grams are at least X (0 .. 1) similar to an earlier one\n"
+           "  --verbose        print the notes of every melody\n"
+           "  --midi FILE      render the notes of a Standard MIDI File into output_dir/FILE.wav instead of generated melodies\n"
+           "  --save-midi      also write every melody as a MIDI file with its seed and parameters\n"
+           "  --no-audio       write only the MIDI files, render the chosen ones later with --midi\n"
+           "  --job FILE       run every line of FILE as a separate job\n"
+           "without flags the parameters are asked interactively\n", program);
+}
+
+struct batch_job_t
+{
+    melody_params_t params;
+    uint32_t seed;
+    bool has_seed = false;
+    int threads = 0;
+    std::string job_file;
+};
+
+bool parse_int(const char* str, int& value)
+{
+    char* end;
+    long v = std::strtol(str, &end, 10);
+    if ((end == str) || (*end != '\0'))
+        return false;
+    value = (int) v;
+    return true;
+}
+
+bool parse_uint(const char* str, uint32_t& value)
+{
+    char* end;
+    unsigned long v = std::strtoul(str, &end, 10);
+    if ((end == str) || (*end != '\0'))
+        return false;
+    value = (uint32_t) v;
+    return true;
+}
+
+bool parse_float(const char* str, float& value)
+{
+    char* end;
+    value = std::strtof(str, &end);
+    return (end != str) && (*end == '\0');
+}
+
+bool parse_instruments(const char* str, std::vector<int>& instruments)
+{
+    std::istringstream list(str);
+    std::string item;
+    instruments.clear();
+    while (std::getline(list, item, ','))
+    {
+        int instrument;
+        if (!parse_int(item.c_str(), instrument) || (instrument < 1) || (instrument > INSTRUMENT_COUNT))
+            return false;
+        instruments.push_back(instrument);
+    }
+    return !instruments.empty();
+}
+
+bool parse_format(const std::string& name, AudioFileFormat& format)
+{
+    if (name == "wav")
+        format = AudioFileFormat::Wave;
+    else if (name == "aiff")
+        format = AudioFileFormat::Aiff;
+    else
+        return false;
+    return true;
+}
+
+bool parse_args(const std::vector<std::string>& args, batch_job_t& job)
+{
+    melody_params_t& params = job.params;
+    params.verbose = false;
+    float sk = 4, sd = 8, hz = 440;
+    int value = 0;
+
+    for (size_t a = 0; a < args.size(); ++a)
+    {
+        const std::string& flag = args[a];
+
+        if (flag == "--verbose")
+        {
+            params.verbose = true;
+            continue;
+        }
+
+        if (flag == "--harmony")
+        {
+            params.harmony = true;
+            continue;
+        }
+
+        if (flag == "--raw")
+        {
+            params.raw = true;
+            continue;
+        }
+
+        if (flag == "--unique")
+        {
+            params.unique = true;
+            continue;
+        }
+
+        if (flag == "--save-midi")
+        {
+            params.save_midi = true;
+            continue;
+        }
+
+        if (flag == "--no-audio")
+        {
+            params.save_midi = true;
+            params.audio = false;
+            continue;
+        }
+
+        if (a + 1 == args.size())
+        {
+            fprintf(stderr, "missing value for %s\n", flag.c_str());
+            return false;
+        }
+
+        const char* arg = args[++a].c_str();
+        bool ok = true;
+
+        if      (flag == "--chords")     ok = parse_int(arg, params.chords) && (params.chords >= 1) && (params.chords <= chords::CHORD_CLASS_COUNT);
+        else if (flag == "--bars")       ok = parse_int(arg, params.bars) && (params.bars >= 0);
+        else if (flag == "--shortest")   ok = parse_float(arg, sk) && valid_duration(sk);
+        else if (flag == "--longest")    ok = parse_float(arg, sd) && valid_duration(sd);
+        else if (flag == "--octave")     { ok = parse_int(arg, params.octave) && (params.octave >= melody_params_t::MIN_OCTAVE) && (params.octave <= melody_params_t::MAX_OCTAVE); --params.octave; }
+        else if (flag == "--count")      ok = parse_int(arg, params.count) && (params.count >= 0);
+        else if (flag == "--syncopes")   { ok = parse_int(arg, value); params.syncopes = value ? 2 : 1; }
+        else if (flag == "--instrument") ok = parse_instruments(arg, params.instruments);
+        else if (flag == "--seed")       { ok = parse_uint(arg, job.seed); job.has_seed = true; }
+        else if (flag == "--rate")       ok = parse_int(arg, params.sample_rate) && (params.sample_rate > 0);
+        else if (flag == "--channels")   ok = parse_int(arg, params.channels) && (params.channels >= 1) && (params.channels <= mixer_t::MAX_CHANNELS);
+        else if (flag == "--bits")       ok = parse_int(arg, params.bit_depth) && ((params.bit_depth == 16) || (params.bit_depth == 24) || (params.bit_depth == 32));
+        else if (flag == "--temperament") ok = pitch::parse_temperament(arg, params.temperament);
+        else if (flag == "--reference")  ok = parse_float(arg, hz) && pitch::parse_reference(hz, params.reference);
+        else if (flag == "--format")     ok = parse_format(arg, params.format);
+        else if (flag == "--similarity") ok = parse_float(arg, params.similarity) && (params.similarity >= 0.0f) && (params.similarity <= 1.0f);
+        else if (flag == "--output")     params.output_dir = arg;
+        else if (flag == "--stream")     params.stream = arg;
+        else if (flag == "--threads")    ok = parse_int(arg, job.threads);
+        else if (flag == "--midi")       params.midi_file = arg;
+        else if (flag == "--job")        job.job_file = arg;
+        else
+        {
+            fprintf(stderr, "unknown flag %s\n", flag.c_str());
+            return false;
+        }
+
+        if (!ok)
+        {
+            fprintf(stderr, "invalid value %s for %s\n", arg, flag.c_str());
+            return false;
+        }
+    }
+
+    set_durations(params, sk, sd);
+    return true;
+}
+
+bool make_directory(const std::string& path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0)
+        return (info.st_mode & S_IFDIR) != 0;
+#if defined(_WIN32)
+    return mkdir(path.c_str()) == 0;
+#else
+    return mkdir(path.c_str(), 0755) == 0;
+#endif
+}
+
+int run_job(batch_job_t& job, std::random_device& rd)
+{
+    if (!make_directory(job.params.output_dir))
+    {
+        fprintf(stderr, "cannot create output directory %s\n", job.params.output_dir.c_str());
+        return 1;
+    }
+
+    if (!job.has_seed)
+        job.seed = rd();
+    const std::string& target = job.params.stream.empty() ? job.params.output_dir : job.params.stream;
+    fprintf(console(job.params), "seed = %u :: rendering %d melodies into %s\n", job.seed, job.params.count, target.c_str());
+
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    batch_stats_t stats = render_melodies(job.params, job.seed, job.threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    double audio = (double) stats.samples / job.params.sample_rate;
+    double megabytes = stats.bytes / (1024.0 * 1024.0);
+    fprintf(console(job.params), "%d melodies, %lld notes, %.1f s of audio, %.1f MB in %.3f s :: %.1f melodies/s, %.1f notes/s, %.1fx real time, %.1f MB/s\n",
+           stats.melodies, (long long) stats.notes, audio, megabytes, seconds,
+           stats.melodies / seconds, stats.notes / seconds, audio / seconds, megabytes / seconds);
+    if (stats.duplicates > 0)
+        fprintf(console(job.params), "%d duplicate melodies skipped\n", stats.duplicates);
+    return 0;
+}
+
+int run_batch(const std::vector<std::string>& args)
+{
+    std::random_device rd;
+    batch_job_t job;
+    if (!parse_args(args, job))
+        return 1;
+
+    if (job.job_file.empty())
+        return run_job(job, rd);
+
+    std::ifstream file(job.job_file);
+    if (!file.good())
+    {
+        fprintf(stderr, "cannot open job file %s\n", job.job_file.c_str());
+        return 1;
+    }
+
+    std::string line;
+    int result = 0;
+    while (std::getline(file, line))
+    {
+        std::istringstream tokens(line);
+        std::vector<std::string> job_args((std::istream_iterator<std::string>(tokens)), std::istream_iterator<std::string>());
+        if (job_args.empty() || (job_args[0][0] == '#'))
+            continue;
+
+        batch_job_t line_job;
+        if (!parse_args(job_args, line_job) || !line_job.job_file.empty())
+        {
+            fprintf(stderr, "skipping invalid job : %s\n", line.c_str());
+            result = 1;
+            continue;
+        }
+        if (line_job.threads == 0)
+            line_job.threads = job.threads;
+        result |= run_job(line_job, rd);
+    }
+    return result;
+}
+
+//=============================================================================================================================================================================
+// interactive mode
+//=============================================================================================================================================================================
+void read_params(melody_params_t& params)
+{
+    int x, t;
     float sk, sd;
 
     std::cout << "kakije akordii hochesh v svojej melodije?" << std::endl;
@@ -349,6 +846,7 @@ start:
         else
             break;
     }
+    params.chords = x;
 
     std::cout << "Skol\'ko hochesh taktov?" << std::endl;
     std::cin >> t;
@@ -357,36 +855,25 @@ start:
         std::cout << "Togda goni " << -t << " taktov, driistovzbzdisharegrapet. Skol\'ko hochesh taktov?" <<std::endl;
         std::cin >> t;
     }
+    params.bars = t;
 
     std::cout << "Kakaja budet samaja korotkaja nota? Jedinitza izmerenija: 1/32. Vozmozhnije tzisla: 1, 1.5, 2, 3, 4, 6, 8, 12, 16, 24 i 32." << std::endl;
     std::cin >> sk;
-
-        if ((sk != 1) && (sk != 1.5) && (sk != 2) && (sk != 3) && (sk != 4) && (sk != 6) && (sk != 8) && (sk != 12) && (sk != 16) && (sk != 24) && (sk != 36))  sk = 4;
     std::cout << "Kakaja budet samaja dlinnaja nota? Jedinitza izmerenija: 1/32." << std::endl;
     std::cin >> sd;
-        if ((sd != 1) && (sd != 1.5) && (sd != 2) && (sd != 3) && (sd != 4) && (sd != 6) && (sd != 8) && (sd != 12) && (sd != 16) && (sd != 24) && (sd != 32))  sd = 8;
-        if (sk > sd) sd = 8;
-
-    float ispdlinot[11];
-    int q = 0;
-    for (int a = 0; a < 11; ++a)
-    {
-        if ((dliniinot[a] <= (sd / 32.0f)) && (dliniinot[a] >= (sk / 32.0f)))
-        {
-            ispdlinot[q] = dliniinot[a];
-            ++q;
-        }
-    }
-
+    set_durations(params, sk, sd);
 
     int i, f, j, s;
     std::cout <<"V kakoj primerno oktave dolzhnii biit\' notii?" <<std::endl;
     std::cin >> i;
+    i = std::min(std::max(i, (int) melody_params_t::MIN_OCTAVE), (int) melody_params_t::MAX_OCTAVE);
     --i;
+    params.octave = i;
 
     std::cout << "Skol\'ko melodij nalabat\'?" <<std::endl;
     std::cin >> f;
     if (f < 0) f = 1;
+    params.count = f;
 
     std::cout << "Hot\'it\'e li vii videt\' sinkopii v vashej melodije, ser? Net - 1; Da - 2; A tche eto? - 3." << std::endl;
     std::cin >> j;
@@ -395,70 +882,58 @@ start:
             std::cout << "objasnenije; Tak che, ho ili net? Net - 1; Da - 2." <<std::endl;
             std::cin >> j;
         }
-
+    params.syncopes = j;
 
     std::cout << "Kakoj instrument? Pianino - 1; Gitara - 2; Bzdudka - 3; ..." <<std::endl;
     std::cin >> s;
-    if ((s > 6) || (s < 1)) s = 1;
-
+    if ((s > INSTRUMENT_COUNT) || (s < 1)) s = 1;
+    params.instruments = { s };
+}
 
 //=============================================================================================================================================================================
 //=============================================================================================================================================================================
 //=============================================================================================================================================================================
-    WAV_writer writer;
 
-    superstart:
-    for (y = 0; y < f; ++y)
-    {
-
-        std::string filename = "output" + std::to_string(y) + ".wav";
-        writer.create(filename);
-        int g = random(0, 11);                                                                  //na skol'ko not uvelichivaestsa nabor not
-        int r = random(min_index[x - 1], max_index[x - 1]);                                           //nomer nabora not
-        float d = 0.0f;
-        int e = random(6, 11);
+int main(int argc, char** argv)
+{
 
-        printf("vasha melodia #%d:\n", y + 1);
+//    process_array(&mix[0][0],    48, "mix");
+//    process_array(&minmin[0][0], 8,  "minmin");
+//    process_array(&majmaj[0][0], 9,  "majmaj");
+//    process_array(&durmol[0][0], 12, "durmol");
+//    process_array(&durdur[0][0], 5,  "durdur");
+//    process_array(&molmol[0][0], 5,  "molmol");
+//    return 0;
+//
+//    audio_buffer_writer_t::notes2file("bethoveen.wav", moonlight_sonata, sonata_length, 8192);
 
-        while (t > d)
+    if (argc > 1)
+    {
+        if ((std::strcmp(argv[1], "--help") == 0) || (std::strcmp(argv[1], "-h") == 0))
         {
-            int c = 0;
-            if (j == 1)
-            {
-                while (ispdlinot[c] > (1 - d + floor(d)))
-                {
-                    ++c;
-                }
-            }
-            float h = ispdlinot[random(c, q - 1)];
-            int o = i + floor(e / 6);
-            int n = e % 6;
-            float freq = frequency(nabornot[r][n], o);
-            printf("{%f, %d, %d} :: %.5f \n", h, o, n, freq);     //kodovaja zapis'
-            writer.fill_note(h, freq);
-            int w = std::max(17 - e, e);
-            int l = random_2(w);
-            e = e + (2 * random(0, 1) - 1) * l;
-            if (e < 0)
-                e = e + 2 * l;
-            if (e > 17)
-                e = e - 2 * l;
-            d = d + h;
+            print_usage(argv[0]);
+            return 0;
         }
-        writer.finish();
+        return run_batch(std::vector<std::string>(argv + 1, argv + argc));
     }
 
+    std::random_device rd;                                                              //used to obtain the seeds for the melody generators
+    melody_params_t params;
+    int u = 1;
 
-    std::cout << "esh\'o ho? Da! :) -- 1; Da, :) i s takimi zhe parametrami! -- 2; Net! :( -- 3" << std::endl;
-    int u;
-    std::cin >> u;
-    if (u == 1)
-        goto start;
-    if (u == 2)
-        goto superstart;
-
-    return 0;
-}
+    while (u != 3)
+    {
+        if (u == 1)
+            read_params(params);
 
+        uint32_t seed = rd();
+        printf("seed = %u\n", seed);
+        render_melodies(params, seed);
 
+        std::cout << "esh\'o ho? Da! :) -- 1; Da, :) i s takimi zhe parametrami! -- 2; Net! :( -- 3" << std::endl;
+        if (!(std::cin >> u))
+            break;
+    }
 
+    return 0;
+}
@@ -0,0 +1,84 @@
+#ifndef __pcm_included_8812093847561029384756102938475610293847561029384756102
+#define __pcm_included_8812093847561029384756102938475610293847561029384756102
+
+//=======================================================================================================================================================================================================================
+// sample encoding shared by stream_writer_t and AudioFile :: normalized floating point samples to 8/16/24/32-bit integer
+// or 32-bit float PCM, the bit depth branch is taken once per block, the inner loops are branch-free
+//=======================================================================================================================================================================================================================
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace pcm {
+
+template<typename T> inline T clamp(T sample)
+    { return std::min<T>(std::max<T>(sample, (T) -1.0), (T) 1.0); }
+
+inline void store16(uint8_t* dst, int32_t v, bool big_endian)
+{
+    if (big_endian) { dst[0] = (uint8_t) (v >> 8); dst[1] = (uint8_t) v; }
+    else            { dst[0] = (uint8_t) v; dst[1] = (uint8_t) (v >> 8); }
+}
+
+inline void store24(uint8_t* dst, int32_t v, bool big_endian)
+{
+    if (big_endian) { dst[0] = (uint8_t) (v >> 16); dst[1] = (uint8_t) (v >> 8); dst[2] = (uint8_t) v; }
+    else            { dst[0] = (uint8_t) v; dst[1] = (uint8_t) (v >> 8); dst[2] = (uint8_t) (v >> 16); }
+}
+
+inline void store32(uint8_t* dst, uint32_t v, bool big_endian)
+{
+    if (big_endian) { dst[0] = (uint8_t) (v >> 24); dst[1] = (uint8_t) (v >> 16); dst[2] = (uint8_t) (v >> 8); dst[3] = (uint8_t) v; }
+    else            { dst[0] = (uint8_t) v; dst[1] = (uint8_t) (v >> 8); dst[2] = (uint8_t) (v >> 16); dst[3] = (uint8_t) (v >> 24); }
+}
+
+//=======================================================================================================================================================================================================================
+// encodes n samples src[0], src[src_stride], ... into dst, dst + dst_stride, ...
+// floating = true selects IEEE float for 32-bit samples, 8-bit samples are unsigned as in WAV files
+// returns false for an unsupported bit depth
+//=======================================================================================================================================================================================================================
+template<typename T> bool encode(const T* src, int n, int src_stride, int bit_depth, bool floating, bool big_endian, uint8_t* dst, int dst_stride)
+{
+    switch (bit_depth)
+    {
+        case 8:
+            for (int i = 0; i < n; ++i, src += src_stride, dst += dst_stride)
+                *dst = (uint8_t) ((clamp(*src) + (T) 1.0) * (T) 127.5);
+            return true;
+
+        case 16:
+            for (int i = 0; i < n; ++i, src += src_stride, dst += dst_stride)
+                store16(dst, (int32_t) (clamp(*src) * (T) 32767.0), big_endian);
+            return true;
+
+        case 24:
+            for (int i = 0; i < n; ++i, src += src_stride, dst += dst_stride)
+                store24(dst, (int32_t) (clamp(*src) * (T) 8388607.0), big_endian);
+            return true;
+
+        case 32:
+            if (floating)
+            {
+                for (int i = 0; i < n; ++i, src += src_stride, dst += dst_stride)
+                {
+                    float f = (float) *src;
+                    uint32_t bits;
+                    std::memcpy(&bits, &f, 4);
+                    store32(dst, bits, big_endian);
+                }
+            }
+            else
+            {
+                for (int i = 0; i < n; ++i, src += src_stride, dst += dst_stride)
+                    store32(dst, (uint32_t) (int32_t) (clamp((double) *src) * 2147483647.0), big_endian);
+            }
+            return true;
+    }
+
+    return false;
+}
+
+} /* namespace pcm */
+
+#endif /* __pcm_included_8812093847561029384756102938475610293847561029384756102 */
@@ -0,0 +1,174 @@
+#ifndef __pitch_included_5561029384756102938475610293847561029384756102938475
+#define __pitch_included_5561029384756102938475610293847561029384756102938475
+
+//=======================================================================================================================================================================================================================
+// compile-time pitch tables :: frequencies of MIDI notes 0 .. 127 for every supported temperament and reference pitch
+// a temperament is given by the deviations of the 12 pitch classes from equal temperament in cents (C based),
+// all tables are generated by constexpr code, nothing is computed at run time
+// the project's (octave, note) pair maps to MIDI note 12 * (octave + 1) + note, so C4 = 60 and A4 = 69
+//=======================================================================================================================================================================================================================
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace pitch {
+
+enum temperament_t
+{
+    EQUAL,
+    PYTHAGOREAN,
+    JUST,
+    MEANTONE,                                   /* quarter-comma */
+    WERCKMEISTER,                               /* Werckmeister III */
+    TEMPERAMENT_COUNT
+};
+
+enum reference_t
+{
+    A440,
+    A442,
+    A432,
+    A415,
+    REFERENCE_COUNT
+};
+
+static constexpr const char* temperament_names[TEMPERAMENT_COUNT] = { "equal", "pythagorean", "just", "meantone", "werckmeister" };
+static constexpr double reference_pitches[REFERENCE_COUNT] = { 440.0, 442.0, 432.0, 415.0 };
+
+static constexpr double temperament_cents[TEMPERAMENT_COUNT][12] =
+{
+    /*    C       C#       D       Eb       E       F       F#       G       G#       A       Bb       B  */
+    {  0.00,    0.00,   0.00,    0.00,   0.00,   0.00,    0.00,   0.00,    0.00,   0.00,    0.00,   0.00 },
+    {  0.00,   -9.78,   3.91,   -5.87,   7.82,  -1.96,   11.73,   1.96,   -7.82,   5.87,   -3.91,   9.78 },
+    {  0.00,   11.73,   3.91,   15.64, -13.69,  -1.96,   -9.78,   1.96,   13.69, -15.64,   17.60, -11.73 },
+    {  0.00,  -23.95,  -6.84,   10.26, -13.69,   3.42,  -20.53,  -3.42,  -27.37, -10.26,    6.84, -17.11 },
+    {  0.00,   -9.78,  -7.82,   -5.87,  -9.78,  -1.96,  -11.73,  -3.91,   -7.82, -11.73,   -3.91,  -7.82 },
+};
+
+//=======================================================================================================================================================================================================================
+// constexpr math :: 2^(1/12) by Newton iterations and 2^x for |x| < 1/24 by the Taylor series of exp
+//=======================================================================================================================================================================================================================
+constexpr double LN2 = 0.69314718055994530942;
+
+constexpr double semitone_ratio()
+{
+    double x = 1.06;
+    for (int i = 0; i < 8; ++i)
+    {
+        double x11 = 1.0;
+        for (int k = 0; k < 11; ++k)
+            x11 *= x;
+        x = x - (x11 * x - 2.0) / (12.0 * x11);
+    }
+    return x;
+}
+
+constexpr double exp2_small(double x)
+{
+    double term = 1.0, sum = 1.0;
+    for (int n = 1; n < 12; ++n)
+    {
+        term *= x * LN2 / n;
+        sum += term;
+    }
+    return sum;
+}
+
+struct pitch_table_t
+{
+    float hz[128];
+
+    constexpr pitch_table_t(double reference, const double (&cents)[12])
+        : hz()
+    {
+        const double r = semitone_ratio();
+        for (int midi = 0; midi < 128; ++midi)
+        {
+            /* reference * 2^((midi - 69) / 12) as a product of whole semitones, then the temperament correction
+               relative to the reference A, so A4 always sounds at the reference pitch */
+            int d = midi - 69;
+            double f = reference;
+            for (int k = 0; k < (d < 0 ? -d : d); ++k)
+                f = (d < 0) ? f / r : f * r;
+            hz[midi] = (float) (f * exp2_small((cents[midi % 12] - cents[9]) / 1200.0));
+        }
+    }
+
+    constexpr float operator[] (int midi) const
+        { return hz[midi]; }
+};
+
+#define PITCH_TABLES(t) { pitch_table_t(reference_pitches[A440], temperament_cents[t]), pitch_table_t(reference_pitches[A442], temperament_cents[t]), \
+                          pitch_table_t(reference_pitches[A432], temperament_cents[t]), pitch_table_t(reference_pitches[A415], temperament_cents[t]) }
+
+static constexpr pitch_table_t tables[TEMPERAMENT_COUNT][REFERENCE_COUNT] =
+{
+    PITCH_TABLES(EQUAL),
+    PITCH_TABLES(PYTHAGOREAN),
+    PITCH_TABLES(JUST),
+    PITCH_TABLES(MEANTONE),
+    PITCH_TABLES(WERCKMEISTER),
+};
+
+#undef PITCH_TABLES
+
+static_assert(tables[EQUAL][A440][69] == 440.0f, "A4 must be the reference pitch");
+static_assert(tables[EQUAL][A440][57] == 220.0f, "octaves must be pure");
+static_assert(tables[JUST][A432][69] == 432.0f, "A4 must be the reference pitch in every temperament");
+
+inline const pitch_table_t& table(temperament_t temperament = EQUAL, reference_t reference = A440)
+    { return tables[temperament][reference]; }
+
+constexpr int midi_note(int octave, int note)
+    { return 12 * (octave + 1) + note; }
+
+/* looks up the table, notes outside the MIDI range are folded into it by whole octaves and scaled back, far out of
+   range the result goes to 0 or infinity */
+inline float frequency(const pitch_table_t& table, int midi)
+{
+    int64_t octaves = 0;
+    if (midi < 0)
+        octaves = -((11 - (int64_t) midi) / 12);
+    else if (midi > 127)
+        octaves = ((int64_t) midi - 116) / 12;
+    return std::ldexp(table[(int) (midi - 12 * octaves)], (int) octaves);
+}
+
+/* parses a temperament name, returns false for an unknown one */
+inline bool parse_temperament(const char* name, temperament_t& temperament)
+{
+    for (int t = 0; t < TEMPERAMENT_COUNT; ++t)
+    {
+        if (std::strcmp(name, temperament_names[t]) == 0)
+        {
+            temperament = (temperament_t) t;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* finds the precomputed reference pitch, returns false if there is no table for it */
+inline bool parse_reference(double hz, reference_t& reference)
+{
+    for (int r = 0; r < REFERENCE_COUNT; ++r)
+    {
+        if (reference_pitches[r] == hz)
+        {
+            reference = (reference_t) r;
+            return true;
+        }
+    }
+    return false;
+}
+
+} /* namespace pitch */
+
+/* frequency of the note in the project's (octave, note) indexing, equal temperament, A4 = 440 Hz */
+inline float frequency(int note, int o)
+{
+    return pitch::frequency(pitch::table(), pitch::midi_note(o, note));
+}
+
+#endif /* __pitch_included_5561029384756102938475610293847561029384756102938475 */
@@ -0,0 +1,140 @@
+#ifndef __playback_stats_included_5502938475610293847561029384756102938475610293847
+#define __playback_stats_included_5502938475610293847561029384756102938475610293847
+
+//=======================================================================================================================================================================================================================
+// playback instrumentation :: timings of the streaming player, written by its threads and read lock-free by anyone
+//  - histogram_t counts microsecond durations in quarter-octave bins (exact below 4 us, up to 16 s), so a handful of
+//    relaxed atomic increments record a value on the audio thread and percentiles come out within 25%
+//  - the device position is kept as the predicted time of stream frame 0, derived from AL_SAMPLE_OFFSET every time
+//    the feeder wakes up; a single atomic keeps the frame -> time mapping consistent for the readers
+//  - the latency of an event is the time from its ingest until the device plays the frame it took effect on,
+//    the output latency is the same for a frame that has just been rendered -- the depth of the ring and of the AL queue
+//=======================================================================================================================================================================================================================
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/* steady clock in microseconds, the time base of every timestamp below */
+inline int64_t clock_us()
+    { return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+struct histogram_t
+{
+    static const int BINS = 96;
+
+    std::atomic<uint32_t> counts[BINS];
+    std::atomic<uint64_t> count { 0 };
+    std::atomic<uint64_t> sum { 0 };
+    std::atomic<int64_t> max { 0 };
+
+    histogram_t()
+        { reset(); }
+
+    /* bins 0..3 hold 0..3 us, above that every octave is split into four linear steps */
+    static int bin(int64_t us)
+    {
+        if (us < 4)
+            return (int) std::max<int64_t>(us, 0);
+        int msb = 63 - __builtin_clzll((uint64_t) us);
+        return std::min(BINS - 1, 4 * (msb - 1) + (int) ((us >> (msb - 2)) & 3));
+    }
+
+    static int64_t lower(int bin)
+        { return (bin < 4) ? bin : (int64_t) (4 + (bin & 3)) << (bin / 4 - 1); }
+
+    void add(int64_t us)
+    {
+        counts[bin(us)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add((uint64_t) std::max<int64_t>(us, 0), std::memory_order_relaxed);
+        int64_t m = max.load(std::memory_order_relaxed);
+        while ((us > m) && !max.compare_exchange_weak(m, us, std::memory_order_relaxed));
+    }
+
+    /* the upper edge of the bin holding the p-th fraction of the values, but no more than the maximum, 0 if there are none */
+    int64_t percentile(double p) const
+    {
+        uint64_t n = count.load(std::memory_order_relaxed);
+        if (n == 0)
+            return 0;
+        uint64_t rank = (uint64_t) (p * n), seen = 0;
+        for (int b = 0; b < BINS; ++b)
+            if ((seen += counts[b].load(std::memory_order_relaxed)) > rank)
+                return (b + 1 < BINS) ? std::min(lower(b + 1), max.load(std::memory_order_relaxed)) : max.load(std::memory_order_relaxed);
+        return max.load(std::memory_order_relaxed);
+    }
+
+    int64_t mean() const
+    {
+        uint64_t n = count.load(std::memory_order_relaxed);
+        return n ? (int64_t) (sum.load(std::memory_order_relaxed) / n) : 0;
+    }
+
+    /* not synchronized with add(), a value recorded at the same moment may be half counted */
+    void reset()
+    {
+        for (int b = 0; b < BINS; ++b)
+            counts[b].store(0, std::memory_order_relaxed);
+        count = 0;
+        sum = 0;
+        max = 0;
+    }
+};
+
+struct playback_stats_t
+{
+    int sample_rate = 44100;
+
+    histogram_t render_time;                                        /* us the render callback took per buffer */
+    histogram_t output_latency;                                     /* us from the end of a render until the device plays its first frame */
+    histogram_t event_latency;                                      /* us from the ingest of an event until the device plays it */
+
+    std::atomic<int64_t> rendered { 0 };                            /* frames written to the ring */
+    std::atomic<int64_t> queued { 0 };                              /* frames handed to AL */
+    std::atomic<int64_t> played { 0 };                              /* frames the device has consumed */
+    std::atomic<int64_t> origin { 0 };                              /* the predicted time of frame 0, 0 until the source plays */
+    std::atomic<int64_t> queue_frames { 0 };                        /* the frames the player keeps in the output queue, it may adapt them */
+
+    void reset(int sample_rate)
+    {
+        this->sample_rate = sample_rate;
+        render_time.reset();
+        output_latency.reset();
+        event_latency.reset();
+        rendered = 0;
+        queued = 0;
+        played = 0;
+        origin = 0;
+        queue_frames = 0;
+    }
+
+    /* called by the feeder with the device position it has just read */
+    void device_position(int64_t frame, int64_t now)
+    {
+        played.store(frame, std::memory_order_relaxed);
+        origin.store(now - frame * 1000000 / sample_rate, std::memory_order_relaxed);
+    }
+
+    /* when the device is expected to play the frame, 0 before playback starts */
+    int64_t play_time(int64_t frame) const
+    {
+        int64_t t0 = origin.load(std::memory_order_relaxed);
+        return t0 ? t0 + frame * 1000000 / sample_rate : 0;
+    }
+
+    /* records the latency of an event ingested at the given time that takes effect on the frame */
+    void event(int64_t ingest, int64_t frame)
+    {
+        int64_t t = play_time(frame);
+        if (t)
+            event_latency.add(t - ingest);
+    }
+
+    /* the time a frame rendered now spends in the ring and in the AL queue */
+    int64_t latency_us() const
+        { return (rendered.load(std::memory_order_relaxed) - played.load(std::memory_order_relaxed)) * 1000000 / sample_rate; }
+};
+
+#endif /* __playback_stats_included_5502938475610293847561029384756102938475610293847 */
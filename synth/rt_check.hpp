@@ -0,0 +1,185 @@
+#ifndef __rt_check_included_4410293847561029384756102938475610293847561029384756
+#define __rt_check_included_4410293847561029384756102938475610293847561029384756
+
+//=======================================================================================================================================================================================================================
+// real-time safety checks for the audio thread
+//  - rt::audio_scope_t marks the code that must never block: the render callback of the player and everything it calls
+//  - built with RT_DEBUG the program interposes malloc / calloc / realloc / free / aligned allocations and
+//    pthread_mutex_lock; any of them called inside an audio scope is reported on stderr with the offending stack
+//    (link with -rdynamic to get symbol names) and counted in rt::violations()
+//  - without RT_DEBUG the scope is an empty object and nothing is interposed
+// the interposers are definitions, not inline functions :: the header may only be included from one translation unit
+// of a program built with RT_DEBUG
+//=======================================================================================================================================================================================================================
+
+#include <atomic>
+#include <cstdint>
+
+#ifdef RT_DEBUG
+#include <cstdio>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#endif
+
+namespace rt {
+
+/* the number of real-time violations seen so far, always 0 without RT_DEBUG */
+inline std::atomic<uint64_t>& violations()
+{
+    static std::atomic<uint64_t> count { 0 };
+    return count;
+}
+
+#ifdef RT_DEBUG
+
+inline int& audio_depth()
+{
+    static thread_local int depth = 0;
+    return depth;
+}
+
+struct audio_scope_t
+{
+    audio_scope_t()
+        { ++audio_depth(); }
+    ~audio_scope_t()
+        { --audio_depth(); }
+};
+
+typedef int (*mutex_lock_f)(pthread_mutex_t*);
+
+/* the C library's pthread_mutex_lock behind the interposer */
+inline mutex_lock_f& next_mutex_lock()
+{
+    static mutex_lock_f next = 0;
+    return next;
+}
+
+/* dlsym may allocate and lock, so the lookup must not happen on the audio thread */
+inline void resolve()
+{
+    if (!next_mutex_lock())
+        next_mutex_lock() = (mutex_lock_f) dlsym(RTLD_NEXT, "pthread_mutex_lock");
+}
+
+/* loads everything the report needs (backtrace pulls in libgcc on its first call), call it once off the audio thread */
+inline void arm()
+{
+    resolve();
+    void* frames[1];
+    backtrace(frames, 1);
+}
+
+/* prints the stack of the violation, the report itself runs outside the scope so it may allocate */
+inline void report(const char* what)
+{
+    int& depth = audio_depth();
+    if (depth <= 0)
+        return;
+    int saved = depth;
+    depth = 0;
+
+    ++violations();
+    fprintf(stderr, "real-time violation on the audio thread :: %s\n", what);
+    void* frames[32];
+    int n = backtrace(frames, 32);
+    backtrace_symbols_fd(frames + 1, n - 1, 2);
+
+    depth = saved;
+}
+
+#else
+
+struct audio_scope_t
+{
+    audio_scope_t()
+        { }
+};
+
+inline void arm()
+{
+}
+
+#endif
+
+} // namespace rt
+
+#ifdef RT_DEBUG
+
+//=======================================================================================================================================================================================================================
+// interposers :: the executable's definitions take precedence over the C library for every caller, operator new and
+// the containers included, the real functions are glibc's __libc_* entry points and the next pthread_mutex_lock
+//=======================================================================================================================================================================================================================
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* p);
+
+void* malloc(size_t size)
+{
+    if (rt::audio_depth() > 0)
+        rt::report("malloc");
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    if (rt::audio_depth() > 0)
+        rt::report("calloc");
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size)
+{
+    if (rt::audio_depth() > 0)
+        rt::report("realloc");
+    return __libc_realloc(p, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    if (rt::audio_depth() > 0)
+        rt::report("aligned_alloc");
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** p, size_t alignment, size_t size)
+{
+    if (rt::audio_depth() > 0)
+        rt::report("posix_memalign");
+    *p = __libc_memalign(alignment, size);
+    return *p ? 0 : 12;                                                                     // ENOMEM
+}
+
+void free(void* p)
+{
+    if (p && (rt::audio_depth() > 0))
+        rt::report("free");
+    __libc_free(p);
+}
+
+/* resolved while the program loads, the lookup in the interposer only serves locks taken by earlier initializers */
+__attribute__((constructor)) static void rt_resolve()
+{
+    rt::resolve();
+}
+
+int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+    if (!rt::next_mutex_lock())
+        rt::resolve();
+    if (rt::audio_depth() > 0)
+        rt::report("pthread_mutex_lock");
+    return rt::next_mutex_lock()(mutex);
+}
+
+} // extern "C"
+
+#endif
+
+#endif /* __rt_check_included_4410293847561029384756102938475610293847561029384756 */
@@ -0,0 +1,136 @@
+#ifndef __rt_thread_included_1060192847561029384756102938475610293847561029384756
+#define __rt_thread_included_1060192847561029384756102938475610293847561029384756
+
+//=======================================================================================================================================================================================================================
+// real-time scheduling for the audio threads :: SCHED_FIFO priority, CPU pinning and locked memory
+//  - every option is a request, a missing privilege is not an error: the thread keeps running with whatever it got
+//    and the outcome is logged and kept in an rt_status_t
+//  - SCHED_FIFO needs CAP_SYS_NICE or an RLIMIT_RTPRIO (e.g. @audio - rtprio 95 in /etc/security/limits.conf);
+//    a priority above the limit is lowered to it
+//  - memory :: mlockall(MCL_CURRENT | MCL_FUTURE) keeps every page of the process resident; it is only tried with an
+//    unlimited RLIMIT_MEMLOCK or as root, under a finite limit MCL_FUTURE would make every later mapping that crosses
+//    it fail -- a thread stack included -- so there the given regions, the sample buffers and arenas the audio thread
+//    touches, are locked one by one instead
+//=======================================================================================================================================================================================================================
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+struct rt_options_t
+{
+    int priority = 0;                                               /* SCHED_FIFO priority 1 .. 99, 0 -- keep the normal policy */
+    int cpu = -1;                                                   /* the core to pin the thread to, -1 -- any */
+    bool lock_memory = false;
+};
+
+struct rt_status_t
+{
+    int priority = 0;                                               /* the SCHED_FIFO priority obtained, 0 -- none */
+    int cpu = -1;                                                   /* the core the thread is pinned to, -1 -- none */
+    int locked = 0;                                                 /* 0 -- nothing, 1 -- the given regions, 2 -- the whole process */
+};
+
+namespace rt {
+
+//=======================================================================================================================================================================================================================
+// applies the scheduling options to the calling thread
+//=======================================================================================================================================================================================================================
+inline rt_status_t configure_thread(const rt_options_t& options, const char* name)
+{
+    rt_status_t status;
+
+    if (options.priority > 0)
+    {
+        sched_param param;
+        param.sched_priority = std::min(options.priority, sched_get_priority_max(SCHED_FIFO));
+        int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (error == EPERM)
+        {
+            rlimit limit;
+            if ((getrlimit(RLIMIT_RTPRIO, &limit) == 0) && (limit.rlim_cur > 0) && ((int) limit.rlim_cur < param.sched_priority))
+            {
+                param.sched_priority = (int) limit.rlim_cur;
+                error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+            }
+        }
+        if (error == 0)
+            status.priority = param.sched_priority;
+        else
+            fprintf(stderr, "%s thread :: SCHED_FIFO %d refused (%s), keeping the normal policy\n", name, options.priority, std::strerror(error));
+    }
+
+    if (options.cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(options.cpu, &set);
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (error == 0)
+            status.cpu = options.cpu;
+        else
+            fprintf(stderr, "%s thread :: cannot pin to CPU %d (%s)\n", name, options.cpu, std::strerror(error));
+    }
+
+    if ((options.priority > 0) || (options.cpu >= 0))
+        fprintf(stdout, "%s thread :: %s %d, CPU %d\n", name, status.priority ? "SCHED_FIFO" : "SCHED_OTHER", status.priority, status.cpu);
+    return status;
+}
+
+//=======================================================================================================================================================================================================================
+// locks the process in memory, or at least the regions, returns the rt_status_t::locked value
+//=======================================================================================================================================================================================================================
+inline int lock_memory(const std::vector<std::pair<const void*, size_t>>& regions)
+{
+    rlimit limit;
+    int error = EPERM;
+    if ((geteuid() == 0) || ((getrlimit(RLIMIT_MEMLOCK, &limit) == 0) && (limit.rlim_cur == RLIM_INFINITY)))
+    {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+        {
+            fprintf(stdout, "memory :: the whole process is locked\n");
+            return 2;
+        }
+        error = errno;
+    }
+
+    size_t bytes = 0;
+    for (const auto& region : regions)
+    {
+        if ((region.second > 0) && (mlock(region.first, region.second) != 0))
+        {
+            fprintf(stderr, "memory :: mlockall not used (%s), mlock of %zu bytes refused (%s), nothing is locked\n", std::strerror(error), region.second, std::strerror(errno));
+            for (const auto& locked : regions)
+            {
+                if (&locked == &region)
+                    break;
+                munlock(locked.first, locked.second);
+            }
+            return 0;
+        }
+        bytes += region.second;
+    }
+    fprintf(stdout, "memory :: mlockall not used (%s), locked %zu bytes of audio buffers instead\n", std::strerror(error), bytes);
+    return 1;
+}
+
+/* touches the given amount of stack so that its pages are resident before the first deadline */
+inline void prefault_stack(size_t bytes = 64 * 1024)
+{
+    volatile char stack[64 * 1024];
+    for (size_t i = 0; i < std::min(bytes, sizeof(stack)); i += 4096)
+        stack[i] = 0;
+}
+
+} // namespace rt
+
+#endif /* __rt_thread_included_1060192847561029384756102938475610293847561029384756 */
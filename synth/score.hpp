@@ -0,0 +1,42 @@
+#ifndef __score_included_7740129385610293847561029384756102938475610293847561
+#define __score_included_7740129385610293847561029384756102938475610293847561
+
+//=======================================================================================================================================================================================================================
+// compact note event list :: the output of the melody generator and the input of the renderer,
+// times are measured in whole notes, notes may overlap, the list is kept sorted by the start time
+//=======================================================================================================================================================================================================================
+
+#include <cstdint>
+#include <vector>
+
+struct note_t
+{
+    float start;
+    float duration;
+    int16_t octave;
+    int8_t note;                                /* semitone within the octave, 0 .. 11 */
+    uint8_t velocity;                           /* 1 .. 127 as in MIDI */
+
+    note_t() {}
+    note_t(float duration, int octave, int note, int velocity = 127) :
+        start(0.0f), duration(duration), octave((int16_t) octave), note((int8_t) note), velocity((uint8_t) velocity) {}
+    note_t(float start, float duration, int octave, int note, int velocity = 127) :
+        start(start), duration(duration), octave((int16_t) octave), note((int8_t) note), velocity((uint8_t) velocity) {}
+};
+
+typedef std::vector<note_t> score_t;
+
+/* builds a monophonic score from notes that follow each other end to end */
+inline score_t sequential_score(const note_t* notes, int size)
+{
+    score_t score(notes, notes + size);
+    float start = 0.0f;
+    for (note_t& note : score)
+    {
+        note.start = start;
+        start += note.duration;
+    }
+    return score;
+}
+
+#endif /* __score_included_7740129385610293847561029384756102938475610293847561 */
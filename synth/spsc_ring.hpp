@@ -0,0 +1,162 @@
+#ifndef __spsc_ring_included_3391028475610293847561029384756102938475610293847561
+#define __spsc_ring_included_3391028475610293847561029384756102938475610293847561
+
+//=======================================================================================================================================================================================================================
+// wait-free single-producer / single-consumer ring of interleaved float frames
+//  - the capacity is a power of two, the read and write positions run freely and are masked on access, so
+//    read_available() == head - tail without a spare slot
+//  - each side owns one position and keeps a cached copy of the other one, it only touches the other side's cache
+//    line when the cached value says the ring is full (producer) or empty (consumer); the positions and the caches
+//    live on separate cache lines so the two threads do not false-share
+//  - write_span / read_span hand out at most two contiguous pieces of the ring for in-place rendering or reading,
+//    commit_write / commit_read publish them; write / read are the copying shorthands
+//  - write() that does not fit counts an overrun, read() asked for more than there is counts an underrun, the frames
+//    that do fit are still transferred
+// the ring has the mixer sink interface, so mixer.render(score, instrument, ring) streams a score straight into it
+//=======================================================================================================================================================================================================================
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+struct spsc_ring_t
+{
+    static const int CACHE_LINE = 64;
+
+    /* up to two contiguous pieces of the ring, second is empty unless the range wraps */
+    struct span_t
+    {
+        float* first = 0;
+        size_t first_frames = 0;
+        float* second = 0;
+        size_t second_frames = 0;
+
+        size_t frames() const
+            { return first_frames + second_frames; }
+    };
+
+    /* a full cache line of padding between the two sides rather than alignas, so the ring needs no over-aligned new */
+    std::atomic<size_t> head { 0 };                                 /* frames written, owned by the producer */
+    size_t cached_tail = 0;                                         /* the producer's last look at tail */
+    char producer_pad[CACHE_LINE];
+
+    std::atomic<size_t> tail { 0 };                                 /* frames read, owned by the consumer */
+    size_t cached_head = 0;                                         /* the consumer's last look at head */
+    char consumer_pad[CACHE_LINE];
+
+    std::atomic<uint64_t> overruns { 0 };
+    std::atomic<uint64_t> underruns { 0 };
+
+    std::vector<float> data;
+    size_t capacity = 0;                                            /* in frames, a power of two */
+    size_t mask = 0;
+    int channels = 1;
+
+    /* allocates room for at least frames frames, not thread safe -- call before the producer and the consumer start */
+    void init(size_t frames, int channels = 1)
+    {
+        capacity = 1;
+        while (capacity < frames)
+            capacity <<= 1;
+        mask = capacity - 1;
+        this->channels = channels;
+        data.assign(capacity * channels, 0.0f);
+        reset();
+    }
+
+    void reset()
+    {
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+        cached_head = cached_tail = 0;
+        overruns = 0;
+        underruns = 0;
+    }
+
+    /* the frames in the ring, exact on neither side while the other one is running */
+    size_t size() const
+        { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+    //===================================================================================================================================================================================================================
+    // producer side
+    //===================================================================================================================================================================================================================
+    size_t write_available()
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (capacity - (h - cached_tail) == 0)
+            cached_tail = tail.load(std::memory_order_acquire);
+        return capacity - (h - cached_tail);
+    }
+
+    /* the free space for up to frames frames, to be filled and then published with commit_write */
+    size_t write_span(span_t& span, size_t frames)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (capacity - (h - cached_tail) < frames)
+            cached_tail = tail.load(std::memory_order_acquire);
+        return make_span(span, h, std::min(frames, capacity - (h - cached_tail)));
+    }
+
+    void commit_write(size_t frames)
+        { head.store(head.load(std::memory_order_relaxed) + frames, std::memory_order_release); }
+
+    size_t write(const float* frames, size_t n)
+    {
+        span_t span;
+        size_t done = write_span(span, n);
+        if (done < n)
+            overruns.fetch_add(1, std::memory_order_relaxed);
+        std::copy(frames, frames + span.first_frames * channels, span.first);
+        std::copy(frames + span.first_frames * channels, frames + done * channels, span.second);
+        commit_write(done);
+        return done;
+    }
+
+    //===================================================================================================================================================================================================================
+    // consumer side
+    //===================================================================================================================================================================================================================
+    size_t read_available()
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (cached_head - t == 0)
+            cached_head = head.load(std::memory_order_acquire);
+        return cached_head - t;
+    }
+
+    /* the next up to frames written frames, released with commit_read once they are consumed */
+    size_t read_span(span_t& span, size_t frames)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (cached_head - t < frames)
+            cached_head = head.load(std::memory_order_acquire);
+        return make_span(span, t, std::min(frames, cached_head - t));
+    }
+
+    void commit_read(size_t frames)
+        { tail.store(tail.load(std::memory_order_relaxed) + frames, std::memory_order_release); }
+
+    size_t read(float* frames, size_t n)
+    {
+        span_t span;
+        size_t done = read_span(span, n);
+        if (done < n)
+            underruns.fetch_add(1, std::memory_order_relaxed);
+        std::copy(span.first, span.first + span.first_frames * channels, frames);
+        std::copy(span.second, span.second + span.second_frames * channels, frames + span.first_frames * channels);
+        commit_read(done);
+        return done;
+    }
+
+    size_t make_span(span_t& span, size_t position, size_t frames)
+    {
+        size_t start = position & mask;
+        span.first = data.data() + start * channels;
+        span.first_frames = std::min(frames, capacity - start);
+        span.second = data.data();
+        span.second_frames = frames - span.first_frames;
+        return frames;
+    }
+};
+
+#endif /* __spsc_ring_included_3391028475610293847561029384756102938475610293847561 */
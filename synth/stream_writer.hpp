@@ -0,0 +1,163 @@
+#ifndef __stream_writer_included_6619203847561029384756102938475610293847561029384
+#define __stream_writer_included_6619203847561029384756102938475610293847561029384
+
+//=======================================================================================================================================================================================================================
+// streaming PCM writer :: sends the rendered audio to stdout, a named FIFO or any other non-seekable file
+//  - RAW : headerless interleaved little-endian PCM, 16/24-bit signed integer or 32-bit float
+//  - WAV : a RIFF header with the chunk sizes set to 0xFFFFFFFF (unknown length) followed by the samples,
+//          the convention understood by sox, ffmpeg and most streaming readers
+// the encoded samples are collected in a large buffer and handed to the OS in BUFFER_SIZE writes,
+// any number of scores may be rendered into one stream one after another
+// SIGPIPE is ignored once a stream is open, so a reader that goes away fails the next write with EPIPE instead of
+// killing the process; from then on ok is false, write() drops the frames and the callers should stop rendering
+//=======================================================================================================================================================================================================================
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mixer.hpp"
+#include "noise.hpp"
+#include "pcm.hpp"
+
+struct stream_writer_t
+{
+    enum format_t
+    {
+        RAW,
+        WAV
+    };
+
+    static const int BUFFER_SIZE = 1 << 20;
+    static const int MAX_CHANNELS = mixer_t::MAX_CHANNELS;
+
+    FILE* stream = 0;
+    bool owned = false;                                             /* false for stdout, which is not closed */
+    std::atomic<bool> ok { true };                                  /* false after a failed write, read by the other pipeline threads */
+    int channels = 1;
+    int bit_depth = 16;
+    int64_t samples_written = 0;                                    /* frames written since open() */
+
+    noise_t noise;
+    std::vector<uint8_t> buffer;
+    size_t used = 0;
+
+    static const int HEADER_MAX = 46;
+
+    /* fills in the RIFF header of a 16/24-bit integer or 32-bit float file, returns its size */
+    static int make_header(uint8_t* header, int sample_rate, int channels, int bit_depth, uint32_t riff_size, uint32_t data_size)
+    {
+        bool floating = (bit_depth == 32);
+        uint8_t* h = header;
+
+        std::memcpy(h, "RIFF", 4);                                  //ASCII for 0x52494646, the magic number that WAV files start with
+        pcm::store32(h + 4, riff_size, false);                      //RIFF chunk size
+        std::memcpy(h + 8, "WAVEfmt ", 8);                          //The beginning of the header
+        pcm::store32(h + 16, floating ? 18 : 16, false);            //PCM header is 16 bytes, the float one has an empty extension
+        pcm::store16(h + 20, floating ? 3 : 1, false);              //WAVE_FORMAT_IEEE_FLOAT or WAVE_FORMAT_PCM
+        pcm::store16(h + 22, channels, false);
+        pcm::store32(h + 24, sample_rate, false);
+        pcm::store32(h + 28, sample_rate * channels * bit_depth / 8, false);   //ByteRate
+        pcm::store16(h + 32, channels * bit_depth / 8, false);                 //BlockAlign
+        pcm::store16(h + 34, bit_depth, false);
+        h += 36;
+        if (floating)
+        {
+            pcm::store16(h, 0, false);                              //extension size
+            h += 2;
+        }
+        std::memcpy(h, "data", 4);
+        pcm::store32(h + 4, data_size, false);                      //data chunk size
+        h += 8;
+
+        return (int) (h - header);
+    }
+
+    int bytes_per_frame() const
+        { return channels * bit_depth / 8; }
+
+    bool is_open() const
+        { return stream != 0; }
+
+    /* path "-" is stdout, anything else is opened for writing, a FIFO blocks here until a reader connects */
+    bool open(const std::string& path, format_t format, int sample_rate, int channels = 1, int bit_depth = 16)
+    {
+        if ((bit_depth != 16 && bit_depth != 24 && bit_depth != 32) || (channels < 1) || (channels > MAX_CHANNELS))
+            return false;
+
+        owned = (path != "-");
+        stream = owned ? std::fopen(path.c_str(), "wb") : stdout;
+        if (stream == 0)
+            return false;
+        if (owned)
+            std::setvbuf(stream, 0, _IONBF, 0);                     //the writes are already large, skip the stdio copy
+        std::signal(SIGPIPE, SIG_IGN);
+
+        this->channels = channels;
+        this->bit_depth = bit_depth;
+        samples_written = 0;
+        ok = true;
+        buffer.resize(BUFFER_SIZE);
+        used = 0;
+
+        if (format == WAV)
+        {
+            uint8_t header[HEADER_MAX];
+            int size = make_header(header, sample_rate, channels, bit_depth, 0xFFFFFFFF, 0xFFFFFFFF);
+            append(header, size);
+        }
+        return true;
+    }
+
+    /* dithers, clips and queues n interleaved frames of normalized samples, the block is modified in place */
+    void write(float* block, int n)
+    {
+        if (!ok)
+            return;
+        noise.add_triangular(block, n * channels, 128.0f / 32768.0f);
+
+        size_t size = (size_t) n * bytes_per_frame();
+        if (used + size > buffer.size())
+            flush();
+        pcm::encode(block, n * channels, 1, bit_depth, true, false, buffer.data() + used, bit_depth / 8);
+        used += size;
+        samples_written += n;
+    }
+
+    void append(const uint8_t* data, int size)
+    {
+        if (used + size > buffer.size())
+            flush();
+        std::copy(data, data + size, buffer.data() + used);
+        used += size;
+    }
+
+    /* hands the buffered bytes to the OS, a failed write (e.g. the reader went away) is remembered in ok */
+    bool flush()
+    {
+        if ((used > 0) && ok)
+            ok = ok && (std::fwrite(buffer.data(), 1, used, stream) == used);
+        used = 0;
+        return ok;
+    }
+
+    bool close()
+    {
+        if (stream == 0)
+            return false;
+        flush();
+        if (owned)
+            ok = (std::fclose(stream) == 0) && ok;
+        else
+            ok = (std::fflush(stream) == 0) && ok;
+        stream = 0;
+        return ok;
+    }
+};
+
+#endif /* __stream_writer_included_6619203847561029384756102938475610293847561029384 */
@@ -0,0 +1,362 @@
+//=======================================================================================================================================================================================================================
+// synth_tests :: self-checks of the engine pieces that need neither a window nor an audio device
+// every failed check is printed with its line, the exit status is the number of failures -- run it through ctest
+//=======================================================================================================================================================================================================================
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "event_queue.hpp"
+#include "melody_hash.hpp"
+#include "midi_file.hpp"
+#include "pcm.hpp"
+#include "pitch.hpp"
+#include "score.hpp"
+#include "spsc_ring.hpp"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { ++failures; fprintf(stderr, "%s:%d: check failed :: %s\n", __FILE__, __LINE__, #condition); } } while (0)
+
+//=======================================================================================================================================================================================================================
+// PCM encoding
+//=======================================================================================================================================================================================================================
+static void test_pcm()
+{
+    const float in[] = { 0.0f, 1.0f, -1.0f, 2.0f, -2.0f, 0.5f };
+    uint8_t out[6 * 4];
+
+    CHECK(pcm::encode(in, 6, 1, 16, false, false, out, 2));
+    CHECK((out[0] == 0x00) && (out[1] == 0x00));
+    CHECK((out[2] == 0xFF) && (out[3] == 0x7F));                                            // 32767, little endian
+    CHECK((out[4] == 0x01) && (out[5] == 0x80));                                            // -32767
+    CHECK((out[6] == 0xFF) && (out[7] == 0x7F));                                            // clipped
+    CHECK((out[8] == 0x01) && (out[9] == 0x80));
+
+    CHECK(pcm::encode(in, 2, 1, 24, false, true, out, 3));
+    CHECK((out[3] == 0x7F) && (out[4] == 0xFF) && (out[5] == 0xFF));                        // 8388607, big endian
+
+    CHECK(pcm::encode(in, 3, 1, 8, false, false, out, 1));
+    CHECK((out[0] == 127) && (out[1] == 255) && (out[2] == 0));                             // unsigned
+
+    CHECK(pcm::encode(in + 5, 1, 1, 32, true, false, out, 4));
+    float f;
+    std::memcpy(&f, out, 4);
+    CHECK(f == 0.5f);
+
+    /* a stride picks one channel out of interleaved frames */
+    const float stereo[] = { 1.0f, 0.0f, -1.0f, 0.0f };
+    CHECK(pcm::encode(stereo, 2, 2, 16, false, false, out, 2));
+    CHECK((out[0] == 0xFF) && (out[1] == 0x7F) && (out[2] == 0x01) && (out[3] == 0x80));
+
+    CHECK(!pcm::encode(in, 1, 1, 12, false, false, out, 2));
+}
+
+//=======================================================================================================================================================================================================================
+// pitch tables :: equal temperament against the formula, every table tuned to its reference A
+//=======================================================================================================================================================================================================================
+static void test_pitch()
+{
+    const pitch::pitch_table_t& equal = pitch::table();
+    double worst = 0.0;
+    for (int midi = 0; midi < 128; ++midi)
+        worst = std::max(worst, std::fabs(equal[midi] / (440.0 * std::pow(2.0, (midi - 69) / 12.0)) - 1.0));
+    CHECK(worst < 1e-6);
+    CHECK(pitch::frequency(equal, -12) == equal[0] * 0.5f);
+    CHECK(pitch::frequency(equal, 139) == equal[127] * 2.0f);
+
+    /* outside 0 .. 127 whole octaves are folded in, without a stack frame per octave */
+    CHECK(pitch::frequency(equal, -1) == equal[11] * 0.5f);
+    CHECK(pitch::frequency(equal, -13) == equal[11] * 0.25f);
+    CHECK(pitch::frequency(equal, 128) == equal[116] * 2.0f);
+    CHECK(pitch::frequency(equal, 140) == equal[116] * 4.0f);
+    CHECK(pitch::frequency(equal, 127 + 12 * 20) == equal[127] * 1048576.0f);
+    CHECK(std::isinf(pitch::frequency(equal, 100000000)));
+    CHECK(std::isinf(pitch::frequency(equal, INT_MAX)));
+    CHECK(pitch::frequency(equal, -100000000) == 0.0f);
+    CHECK(pitch::frequency(equal, INT_MIN) == 0.0f);
+    CHECK(std::fabs(frequency(0, 4) - 261.6256f) < 1e-3f);                                  // middle C
+
+    for (int t = 0; t < pitch::TEMPERAMENT_COUNT; ++t)
+        for (int r = 0; r < pitch::REFERENCE_COUNT; ++r)
+        {
+            const pitch::pitch_table_t& table = pitch::table((pitch::temperament_t) t, (pitch::reference_t) r);
+            CHECK(table[69] == (float) pitch::reference_pitches[r]);
+            for (int midi = 12; midi < 128; ++midi)
+                CHECK(std::fabs(table[midi] / table[midi - 12] - 2.0f) < 1e-5f);            // pure octaves
+        }
+}
+
+//=======================================================================================================================================================================================================================
+// MinHash :: the estimate tracks the Jaccard similarity of the n-gram sets, the filter rejects copies and near copies
+//=======================================================================================================================================================================================================================
+static void test_minhash()
+{
+    /* grams 0 .. 99 against 50 .. 149 :: 50 shared out of 150 */
+    melody_hash_t a, b;
+    a.reset();
+    b.reset();
+    for (uint64_t gram = 0; gram < 100; ++gram)
+    {
+        a.insert(gram);
+        b.insert(gram + 50);
+    }
+    float estimate = melody_hash_t::similarity(a.signature, b.signature);
+    CHECK(std::fabs(estimate - 1.0f / 3.0f) < 0.2f);
+    CHECK(melody_hash_t::similarity(a.signature, a.signature) == 1.0f);
+
+    melody_filter_t filter;
+    filter.set_threshold(0.5f);
+    CHECK(filter.rows * filter.bands == melody_hash_t::SIGNATURE);
+
+    auto fingerprint = [](const score_t& score)
+    {
+        melody_hash_t hash;
+        hash.minhash = true;
+        hash.reset();
+        for (const note_t& note : score)
+            hash.add(note);
+        return hash;
+    };
+
+    score_t melody;
+    for (int i = 0; i < 64; ++i)
+        melody.push_back(note_t(0.125f * (1 + i % 3), 4 + i % 2, (i * 7) % 12));
+    score_t copy = melody;
+    score_t near = melody;
+    near[40].note = (int8_t) ((near[40].note + 1) % 12);
+    score_t other;
+    for (int i = 0; i < 64; ++i)
+        other.push_back(note_t(0.0625f * (1 + i % 5), 3, (i * 5) % 12));
+
+    CHECK(filter.accept(fingerprint(melody)));
+    CHECK(!filter.accept(fingerprint(copy)));
+    CHECK(!filter.accept(fingerprint(near)));
+    CHECK(filter.accept(fingerprint(other)));
+}
+
+//=======================================================================================================================================================================================================================
+// MIDI :: a score saved and loaded again gives back the same notes, in start order
+//=======================================================================================================================================================================================================================
+static bool same_notes(score_t a, score_t b)
+{
+    auto order = [](const note_t& x, const note_t& y)
+    {
+        return std::make_tuple(x.start, pitch::midi_note(x.octave, x.note), x.duration, x.velocity) <
+               std::make_tuple(y.start, pitch::midi_note(y.octave, y.note), y.duration, y.velocity);
+    };
+    std::sort(a.begin(), a.end(), order);
+    std::sort(b.begin(), b.end(), order);
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if ((std::fabs(a[i].start - b[i].start) > 1e-4f) || (std::fabs(a[i].duration - b[i].duration) > 1e-4f) || (a[i].octave != b[i].octave) ||
+            (a[i].note != b[i].note) || (a[i].velocity != b[i].velocity))
+            return false;
+    return true;
+}
+
+static void test_midi_round_trip()
+{
+    const std::string path = "synth_tests.mid";
+
+    note_t melody[] = { note_t(0.25f, 4, 0, 100), note_t(0.125f, 4, 4, 90), note_t(0.125f, 4, 7, 80), note_t(0.5f, 5, 0, 127), note_t(0.0625f, 3, 11, 1) };
+    score_t score = sequential_score(melody, sizeof(melody) / sizeof(melody[0]));
+    CHECK(save_midi(path, score, "seed = 1"));
+    score_t loaded;
+    CHECK(load_midi(path, loaded));
+    CHECK(same_notes(score, loaded));
+    CHECK(std::is_sorted(loaded.begin(), loaded.end(), [](const note_t& a, const note_t& b) { return a.start < b.start; }));
+
+    /* a harmony note under a longer melody note of the same key, and one that starts with it */
+    score.push_back(note_t(0.125f, 0.5f, 4, 0, 60));
+    score.push_back(note_t(0.0f, 0.125f, 4, 0, 50));
+    score.push_back(note_t(0.5f, 0.5f, 5, 0, 40));
+    std::stable_sort(score.begin(), score.end(), [](const note_t& a, const note_t& b) { return a.start < b.start; });
+    CHECK(save_midi(path, score));
+    CHECK(load_midi(path, loaded));
+    CHECK(same_notes(score, loaded));
+
+    /* a different whole note scales the file time, not the score */
+    CHECK(save_midi(path, score, "", 1.5f));
+    CHECK(load_midi(path, loaded, 1.5f));
+    CHECK(same_notes(score, loaded));
+
+    /* a note rounding to no ticks lasts one instead of being held to the end of the track */
+    score_t blip = { note_t(0.0f, 0.0f, 4, 0, 100), note_t(0.25f, 0.25f, 4, 2, 100) };
+    CHECK(save_midi(path, blip));
+    CHECK(load_midi(path, loaded));
+    CHECK(loaded.size() == 2);
+    CHECK((loaded.size() == 2) && (std::fabs(loaded[0].duration - 1.0f / (4 * midi::EXPORT_DIVISION)) < 1e-6f));
+    CHECK((loaded.size() == 2) && (std::fabs(loaded[1].duration - 0.25f) < 1e-4f));
+
+    std::remove(path.c_str());
+}
+
+//=======================================================================================================================================================================================================================
+// spsc_ring_t
+//=======================================================================================================================================================================================================================
+static void test_spsc_ring()
+{
+    spsc_ring_t ring;
+    ring.init(100, 2);
+    CHECK(ring.capacity == 128);
+    CHECK(ring.write_available() == 128);
+
+    /* wraps around the end of the storage, both in pieces and in the copying calls */
+    float in[2 * 96], out[2 * 96];
+    float value = 0.0f;
+    for (int round = 0; round < 10; ++round)
+    {
+        for (int i = 0; i < 2 * 96; ++i)
+            in[i] = value++;
+        CHECK(ring.write(in, 96) == 96);
+        CHECK(ring.read_available() == 96);
+        CHECK(ring.read(out, 96) == 96);
+        CHECK(std::equal(in, in + 2 * 96, out));
+    }
+    CHECK(ring.overruns == 0);
+    CHECK(ring.underruns == 0);
+
+    /* too much to write or to read transfers what fits and counts it */
+    CHECK(ring.write(in, 96) == 96);
+    CHECK(ring.write(in, 96) == 32);
+    CHECK(ring.overruns == 1);
+    CHECK(ring.read(out, 96) == 96);
+    CHECK(ring.read(out, 96) == 32);
+    CHECK(ring.read(out, 1) == 0);
+    CHECK(ring.underruns == 2);
+}
+
+/* a producer rendering in place and a consumer reading copies, the frames arrive complete and in order */
+static void test_spsc_ring_threads()
+{
+    const int FRAMES = 1 << 20;
+
+    spsc_ring_t ring;
+    ring.init(1000);
+    std::thread producer([&ring]()
+    {
+        int next = 0, chunk = 1;
+        while (next < FRAMES)
+        {
+            spsc_ring_t::span_t span;
+            size_t n = ring.write_span(span, (size_t) std::min(chunk, FRAMES - next));
+            for (size_t i = 0; i < span.first_frames; ++i)
+                span.first[i] = (float) next++;
+            for (size_t i = 0; i < span.second_frames; ++i)
+                span.second[i] = (float) next++;
+            ring.commit_write(n);
+            chunk = chunk % 700 + 13;
+            if (n == 0)
+                std::this_thread::yield();
+        }
+    });
+
+    std::vector<float> block(1024);
+    int expected = 0, chunk = 1;
+    bool ordered = true;
+    while (expected < FRAMES)
+    {
+        size_t n = ring.read(block.data(), (size_t) std::min(chunk, FRAMES - expected));
+        for (size_t i = 0; i < n; ++i, ++expected)
+            ordered = ordered && (block[i] == (float) expected);
+        chunk = chunk % 511 + 7;
+        if (n == 0)
+            std::this_thread::yield();
+    }
+    producer.join();
+
+    CHECK(ordered);
+    CHECK(expected == FRAMES);
+    CHECK(ring.read_available() == 0);
+}
+
+//=======================================================================================================================================================================================================================
+// event_queue_t
+//=======================================================================================================================================================================================================================
+static void test_event_queue()
+{
+    event_queue_t queue;
+    note_event_t event;
+    CHECK(!queue.pop(event));
+
+    /* a full queue drops the event and counts it */
+    for (int i = 0; i < event_queue_t::SIZE; ++i)
+        CHECK(queue.push(note_event_t::make(note_event_t::NOTE_ON, i & 0x7F, 100, i)));
+    CHECK(!queue.push(note_event_t::make(note_event_t::NOTE_OFF, 0, 0, 0)));
+    CHECK(queue.dropped == 1);
+    for (int i = 0; i < event_queue_t::SIZE; ++i)
+        CHECK(queue.pop(event) && (event.time == i) && (event.key == (i & 0x7F)));
+    CHECK(!queue.pop(event));
+}
+
+/* several producers posting at once, every event arrives once and the events of one producer stay in order */
+static void test_event_queue_threads()
+{
+    const int PRODUCERS = 4;
+    const int EVENTS = 100000;
+
+    event_queue_t queue;
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; ++p)
+        producers.emplace_back([&queue, p]()
+        {
+            for (int i = 0; i < EVENTS; ++i)
+                while (!queue.push(note_event_t::make(note_event_t::NOTE_ON, p, 100, i, p)))
+                    std::this_thread::yield();
+        });
+
+    int64_t next[PRODUCERS] = {};
+    int received = 0;
+    bool ordered = true;
+    while (received < PRODUCERS * EVENTS)
+    {
+        note_event_t event;
+        if (!queue.pop(event))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        ordered = ordered && (event.key == event.channel) && (event.key < PRODUCERS) && (event.time == next[event.key]);
+        if (event.key < PRODUCERS)
+            ++next[event.key];
+        ++received;
+    }
+    for (std::thread& producer : producers)
+        producer.join();
+
+    CHECK(ordered);
+    CHECK(received == PRODUCERS * EVENTS);
+    for (int p = 0; p < PRODUCERS; ++p)
+        CHECK(next[p] == EVENTS);
+    note_event_t event;
+    CHECK(!queue.pop(event));
+}
+
+int main()
+{
+    test_pcm();
+    test_pitch();
+    test_minhash();
+    test_midi_round_trip();
+    test_spsc_ring();
+    test_spsc_ring_threads();
+    test_event_queue();
+    test_event_queue_threads();
+
+    if (failures)
+        fprintf(stderr, "%d checks failed\n", failures);
+    else
+        printf("all checks passed\n");
+    return failures;
+}